@@ -93,8 +93,6 @@ StartTxCallback (std::string path,
 //----------------------------------------------
 int main (int argc, char *argv[]) {
 
-  PacketMetadata::Enable(); 
-  ns3::Packet::EnablePrinting();
   int nodeAmount = 3;
   int distance = 50;
   double interval = 0.001;
@@ -123,37 +121,10 @@ int main (int argc, char *argv[]) {
   //------------------------------------------------------------
   //-- Create Net device
   //--------------------------------------------
-  NS_LOG_INFO ("Create traffic source & sink.");
-  Ptr<SpcNetDevice> netDevices[nodeAmount];
-  NetDeviceContainer netDeviceContainer;
-  for(int i = 0; i < nodeAmount; i++)
-    {
-      Ptr<Node> node = NodeList::GetNode (i);
-      netDevices [i] = CreateObject<SpcNetDevice>();
-      netDeviceContainer.Add(netDevices [i]);
-      node->AddDevice (netDevices [i]);
-    }
-  int64_t currentStream = stream = 0;
-  for (int i = 0; i < nodeAmount; i++)
-    {
-      Ptr<Node>         node     = NodeList::GetNode (i);
-      Ptr<SpcNetDevice> device   = netDevices [i];
-      Ptr<SpcPhy>       phy      = device->GetPhy ();
-      phy->SetMobility (node);
-      phy->SetDevice (device);
-      netDevices [i]->SetAddress (Mac48Address::Allocate ());
-      currentStream += netDevices [i]->GetMac ()->AssignStreams (currentStream);
-      currentStream += netDevices [i]->GetMac ()->GetPhy ()->AssignStreams (currentStream);
-    }
-  for (int i = 0; i < nodeAmount; i++)
-    {
-      Ptr<SpcChannel> channel= netDevices [i]->GetMac ()->GetPhy ()->GetChannel ();
-      for (int j = 0; j < nodeAmount; j++)
-        {
-          Ptr<SpcPhy> phy = netDevices [j]->GetMac ()->GetPhy ();
-          channel->Add (phy);
-        }
-    }
+  NS_LOG_INFO ("Create net devices on a shared channel.");
+  SpcMacHelper spc;
+  NetDeviceContainer netDeviceContainer = spc.Install (nodes);
+  spc.AssignStreams (netDeviceContainer, 0);
   Ipv4AddressHelper ipAddrs;
   ipAddrs.SetBase ("192.168.0.0", "255.255.255.0");
   ipAddrs.Assign (netDeviceContainer);
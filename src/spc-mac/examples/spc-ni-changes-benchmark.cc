@@ -0,0 +1,119 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Micro-benchmark of the NiChanges store of SpcInterferenceHelper.
+ *
+ * Frames start every nanosecond and last between n and 2n ns, so about
+ * n of them overlap and the store holds about 2n changes.  The same
+ * arrivals are fed to SpcInterferenceHelper and to a copy of the former
+ * sorted std::vector store, and the wall-clock time of both is printed.
+ *
+ *   ./waf --run "spc-ni-changes-benchmark --concurrent=10000"
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/spc-interference-helper.h"
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <ctime>
+
+using namespace ns3;
+
+namespace {
+
+/// The store as it was before: sorted vector, insert and erase in place
+class VectorNiChanges
+{
+public:
+  VectorNiChanges ()
+    : m_firstPower (0)
+  {
+  }
+  Ptr<SpcInterferenceHelper::Event> Add (uint32_t size, Time duration, double rxPowerW, SpcPreamble preamble)
+  {
+    Ptr<SpcInterferenceHelper::Event> event = Create<SpcInterferenceHelper::Event> (size, duration, rxPowerW, preamble);
+    Time now = Simulator::Now ();
+    std::vector<Change>::iterator nowIterator = std::upper_bound (m_changes.begin (), m_changes.end (), Change (now, 0));
+    for (std::vector<Change>::iterator i = m_changes.begin (); i != nowIterator; i++)
+      {
+        m_firstPower += i->second;
+      }
+    m_changes.erase (m_changes.begin (), nowIterator);
+    m_changes.insert (m_changes.begin (), Change (event->GetStartTime (), rxPowerW));
+    Change end (event->GetEndTime (), -rxPowerW);
+    m_changes.insert (std::upper_bound (m_changes.begin (), m_changes.end (), end), end);
+    return event;
+  }
+private:
+  struct Change : public std::pair<Time, double>
+  {
+    Change (Time time, double delta)
+      : std::pair<Time, double> (time, delta)
+    {
+    }
+    bool operator < (const Change &o) const
+    {
+      return first < o.first;
+    }
+  };
+  std::vector<Change> m_changes;
+  double m_firstPower;
+};
+
+std::vector<Time> g_durations;
+
+template <typename T>
+void
+AddFrame (T *store, uint32_t i)
+{
+  SpcPreamble preamble;
+  store->Add (100, g_durations[i], 1e-9, preamble);
+}
+
+template <typename T>
+double
+Run (T *store, uint32_t frames)
+{
+  for (uint32_t i = 0; i < frames; i++)
+    {
+      Simulator::Schedule (NanoSeconds (i), &AddFrame<T>, store, i);
+    }
+  std::clock_t start = std::clock ();
+  Simulator::Run ();
+  std::clock_t stop = std::clock ();
+  Simulator::Destroy ();
+  return (double)(stop - start) / CLOCKS_PER_SEC;
+}
+
+} // anonymous namespace
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t concurrent = 1000;
+  uint32_t rounds = 10;
+
+  CommandLine cmd;
+  cmd.AddValue ("concurrent", "Number of overlapping frames", concurrent);
+  cmd.AddValue ("rounds", "Frames sent, in multiples of concurrent", rounds);
+  cmd.Parse (argc,argv);
+
+  uint32_t frames = concurrent * rounds;
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  random->SetStream (1);
+  for (uint32_t i = 0; i < frames; i++)
+    {
+      g_durations.push_back (NanoSeconds (concurrent + random->GetInteger (0, concurrent - 1)));
+    }
+
+  VectorNiChanges baseline;
+  double vectorSeconds = Run (&baseline, frames);
+  SpcInterferenceHelper helper;
+  double helperSeconds = Run (&helper, frames);
+
+  std::cout << "concurrent=" << concurrent << " frames=" << frames << std::endl
+            << "  vector store:          " << vectorSeconds << " s" << std::endl
+            << "  SpcInterferenceHelper: " << helperSeconds << " s" << std::endl;
+  return 0;
+}
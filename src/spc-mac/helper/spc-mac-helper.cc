@@ -1,11 +1,97 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
 
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "ns3/mac48-address.h"
+#include "ns3/spc-net-device.h"
+#include "ns3/spc-mac.h"
+#include "ns3/spc-phy.h"
 #include "spc-mac-helper.h"
 
+NS_LOG_COMPONENT_DEFINE ("SpcMacHelper");
+
 namespace ns3 {
 
-/* ... */
+SpcMacHelper::SpcMacHelper ()
+{
+  m_channel = CreateObject<SpcChannel> ();
+}
+
+SpcMacHelper::~SpcMacHelper ()
+{
+}
+
+void
+SpcMacHelper::SetChannel (Ptr<SpcChannel> channel)
+{
+  m_channel = channel;
+}
 
+Ptr<SpcChannel>
+SpcMacHelper::GetChannel (void) const
+{
+  return m_channel;
+}
+
+NetDeviceContainer
+SpcMacHelper::Install (Ptr<Node> node) const
+{
+  return Install (NodeContainer (node));
+}
+
+NetDeviceContainer
+SpcMacHelper::Install (NodeContainer c) const
+{
+  NetDeviceContainer devices;
+  for (NodeContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<Node> node = *i;
+      Ptr<SpcNetDevice> device = CreateObject<SpcNetDevice> ();
+      node->AddDevice (device);
+      Ptr<SpcPhy> phy = device->GetPhy ();
+      phy->SetMobility (node);
+      phy->SetDevice (device);
+      phy->SetChannel (m_channel);
+      device->SetAddress (Mac48Address::Allocate ());
+      devices.Add (device);
+      NS_LOG_DEBUG ("node=" << node->GetId () << ", address=" << device->GetAddress ());
+    }
+  return devices;
+}
 
+int64_t
+SpcMacHelper::AssignStreams (NetDeviceContainer c, int64_t stream)
+{
+  int64_t currentStream = stream;
+  for (NetDeviceContainer::Iterator i = c.Begin (); i != c.End (); ++i)
+    {
+      Ptr<SpcNetDevice> device = DynamicCast<SpcNetDevice> (*i);
+      if (device == 0)
+        {
+          continue;
+        }
+      currentStream += device->GetMac ()->AssignStreams (currentStream);
+      currentStream += device->GetPhy ()->AssignStreams (currentStream);
+    }
+  return (currentStream - stream);
 }
 
+} // namespace ns3
@@ -1,12 +1,68 @@
 /* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
 #ifndef SPC_MAC_HELPER_H
 #define SPC_MAC_HELPER_H
 
+#include <stdint.h>
+#include "ns3/ptr.h"
+#include "ns3/node-container.h"
+#include "ns3/net-device-container.h"
+#include "ns3/spc-channel.h"
+
 namespace ns3 {
 
-/* ... */
+/**
+ * \brief create SpcNetDevice objects attached to one shared SpcChannel
+ *
+ * Every phy installed by the same helper is added to the same channel,
+ * so a topology of N nodes holds one channel with N phys.
+ */
+class SpcMacHelper
+{
+public:
+  SpcMacHelper ();
+  ~SpcMacHelper ();
 
-}
+  void SetChannel (Ptr<SpcChannel> channel);
+  Ptr<SpcChannel> GetChannel (void) const;
 
-#endif /* SPC_MAC_HELPER_H */
+  /**
+   * Create one SpcNetDevice per node, allocate its MAC address and
+   * attach its phy to the shared channel.  Mobility models may be
+   * aggregated to the nodes before or after this call.
+   */
+  NetDeviceContainer Install (NodeContainer c) const;
+  NetDeviceContainer Install (Ptr<Node> node) const;
+
+  /**
+   * Assign fixed random variable streams to the MAC and the phy of
+   * every device, in device order.
+   *
+   * \return the number of stream indices assigned
+   */
+  int64_t AssignStreams (NetDeviceContainer c, int64_t stream);
 
+private:
+  Ptr<SpcChannel> m_channel;
+};
+
+} // namespace ns3
+
+#endif /* SPC_MAC_HELPER_H */
@@ -24,6 +24,13 @@ NS_LOG_COMPONENT_DEFINE ("PacketInfo");
 
 namespace ns3 {
 
+namespace {
+const uint16_t ETHER_TYPE_IPV4 = 0x0800;
+const uint16_t ETHER_TYPE_ARP = 0x0806;
+const uint8_t IP_PROTOCOL_ICMP = 1;
+const uint8_t IP_PROTOCOL_UDP = 17;
+} // anonymous namespace
+
 PacketInfo::~PacketInfo ()
 {
 }
@@ -86,9 +93,6 @@ PacketInfo::CreatePacket ()
 void
 PacketInfo::SetPacketInfo (Ptr<Packet> packet)
 {
-  PacketMetadata::ItemIterator it = packet->BeginItem ();
-  PacketMetadata::Item item;
-  
   isUdp  = false;
   isArp  = false;
   isIpv4 = false;
@@ -100,100 +104,93 @@ PacketInfo::SetPacketInfo (Ptr<Packet> packet)
   
   uint32_t headerSize = 0;
   uint32_t packetSize = packet->GetSize ();
-  while (it.HasNext ())
+  // read the headers from the buffer rather than the packet metadata,
+  // so the metadata may stay disabled
+  if (packetSize < llc.GetSerializedSize ())
     {
-      item = it.Next ();
-      if (item.type == PacketMetadata::Item::HEADER)
-	{
-	  NS_LOG_DEBUG (item.tid.GetName ());
-	  if (item.tid.GetName () == "ns3::LlcSnapHeader")
-	    {
-	      NS_LOG_INFO ("LlcSnap header found.");
-	      packet->PeekHeader (llc);
-	      NS_LOG_DEBUG(llc);
-	      headerSize += llc.GetSerializedSize ();
-	      isLlc = true;
-	    }
-	  
-	  if (item.tid.GetName () == "ns3::ArpHeader")
-	    {
-	      NS_LOG_INFO ("Arp header found.");
-	      packet->RemoveHeader (llc);
-	      packet->RemoveHeader (arp);
-	      NS_LOG_DEBUG(arp);
-	      headerSize += arp.GetSerializedSize ();
-	      isArp = true;
-	    }
-	  
-	  if (item.tid.GetName () == "ns3::Ipv4Header")
-	    {
-	      NS_LOG_INFO ("IPv4 header found.");
-	      ipv4.Deserialize(item.current);
-	      NS_LOG_DEBUG(ipv4);
-	      headerSize += ipv4.GetSerializedSize ();
-	      isIpv4 = true;
-	    }
-	  
-	  if (item.tid.GetName () == "ns3::UdpHeader")
-	    {
-	      NS_LOG_INFO ("Udp header found.");
-	      packet->PeekHeader (udp);
-	      NS_LOG_DEBUG(udp);
-	      headerSize += udp.GetSerializedSize ();
-	      isUdp = true;
-	    }
-
-	  if (item.tid.GetName () == "ns3::Icmpv4Header")
-	    {
-	      NS_LOG_INFO ("Icmpv4 header found.");
-	      packet->RemoveHeader (llc);
-	      packet->RemoveHeader (ipv4);
-	      packet->RemoveHeader (icmp);
-	      NS_LOG_DEBUG(icmp);
-	      headerSize += icmp.GetSerializedSize ();
-	      isIcmp = true;
-	    }
-
-	  if (item.tid.GetName () == "ns3::Icmpv4DestinationUnreachable")
-	    {
-	      NS_LOG_INFO ("Icmpv4DestinationUnreachable found.");
-	      packet->PeekHeader (icmpUn);
-	      NS_LOG_DEBUG(icmpUn);
-	      headerSize += 4 + 5 * 4 + 8;
-	      isIcmpUn = true;
-	    }
+      size = packetSize;
+      return;
+    }
+  packet->RemoveHeader (llc);
+  NS_LOG_DEBUG (llc);
+  headerSize += llc.GetSerializedSize ();
+  isLlc = true;
 
-	  if (item.tid.GetName () == "ns3::Icmpv4Echo")
+  if (llc.GetType () == ETHER_TYPE_ARP)
+    {
+      NS_LOG_INFO ("Arp header found.");
+      packet->RemoveHeader (arp);
+      NS_LOG_DEBUG (arp);
+      headerSize += arp.GetSerializedSize ();
+      isArp = true;
+    }
+  else if (llc.GetType () == ETHER_TYPE_IPV4)
+    {
+      NS_LOG_INFO ("IPv4 header found.");
+      packet->RemoveHeader (ipv4);
+      NS_LOG_DEBUG (ipv4);
+      headerSize += ipv4.GetSerializedSize ();
+      isIpv4 = true;
+      if (ipv4.GetFragmentOffset () != 0)
+	{
+	  // only the first fragment carries the transport header
+	  NS_LOG_INFO ("Ipv4 fragment at offset " << ipv4.GetFragmentOffset ());
+	}
+      else if (ipv4.GetProtocol () == IP_PROTOCOL_UDP)
+	{
+	  NS_LOG_INFO ("Udp header found.");
+	  packet->PeekHeader (udp);
+	  NS_LOG_DEBUG (udp);
+	  headerSize += udp.GetSerializedSize ();
+	  isUdp = true;
+	}
+      else if (ipv4.GetProtocol () == IP_PROTOCOL_ICMP)
+	{
+	  NS_LOG_INFO ("Icmpv4 header found.");
+	  packet->RemoveHeader (icmp);
+	  NS_LOG_DEBUG (icmp);
+	  headerSize += icmp.GetSerializedSize ();
+	  isIcmp = true;
+	  switch (icmp.GetType ())
 	    {
+	    case Icmpv4Header::ECHO:
+	    case Icmpv4Header::ECHO_REPLY:
 	      NS_LOG_INFO ("Icmpv4Echo found.");
 	      packet->PeekHeader (icmpEcho);
-	      NS_LOG_DEBUG(icmpEcho);
+	      NS_LOG_DEBUG (icmpEcho);
 	      headerSize += icmpEcho.GetSerializedSize ();
 	      isIcmpEcho = true;
-	    }
-
-	  if (item.tid.GetName () == "ns3::Icmpv4TimeExceeded")
-	    {
+	      break;
+	    case Icmpv4Header::DEST_UNREACH:
+	      NS_LOG_INFO ("Icmpv4DestinationUnreachable found.");
+	      packet->PeekHeader (icmpUn);
+	      NS_LOG_DEBUG (icmpUn);
+	      headerSize += 4 + 5 * 4 + 8;
+	      isIcmpUn = true;
+	      break;
+	    case Icmpv4Header::TIME_EXCEEDED:
 	      NS_LOG_INFO ("Icmpv4TimeExceeded found.");
 	      packet->PeekHeader (icmpTE);
-	      NS_LOG_DEBUG(icmpTE);
+	      NS_LOG_DEBUG (icmpTE);
 	      headerSize += icmpTE.GetSerializedSize ();
 	      isIcmpTE = true;
+	      break;
+	    default:
+	      break;
 	    }
-
 	}
     }
   size = packetSize -headerSize;
 }
 
 uint16_t
-PacketInfo::GetDestPort ()
+PacketInfo::GetDestPort () const
 {
   return udp.GetDestinationPort ();
 }
 
 uint16_t
-PacketInfo::GetSize ()
+PacketInfo::GetSize () const
 {
   return size;
 }
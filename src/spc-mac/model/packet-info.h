@@ -38,8 +38,8 @@ public:
   PacketInfo ();
   Ptr<Packet> CreatePacket ();
   void SetPacketInfo (Ptr<Packet> packet);
-  uint16_t GetDestPort ();
-  uint16_t GetSize ();
+  uint16_t GetDestPort () const;
+  uint16_t GetSize () const;
   void SetSize (uint16_t size);
 private:
   UdpHeader     udp;
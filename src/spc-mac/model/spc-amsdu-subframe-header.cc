@@ -0,0 +1,84 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#include "spc-amsdu-subframe-header.h"
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (SpcAmsduSubframeHeader);
+
+SpcAmsduSubframeHeader::SpcAmsduSubframeHeader ()
+  : m_length (0)
+{
+}
+SpcAmsduSubframeHeader::~SpcAmsduSubframeHeader ()
+{
+}
+
+TypeId
+SpcAmsduSubframeHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SpcAmsduSubframeHeader")
+    .SetParent<Header> ()
+    .AddConstructor<SpcAmsduSubframeHeader> ()
+  ;
+  return tid;
+}
+TypeId
+SpcAmsduSubframeHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+void
+SpcAmsduSubframeHeader::Print (std::ostream &os) const
+{
+  os << "length=" << m_length;
+}
+uint32_t
+SpcAmsduSubframeHeader::GetSerializedSize (void) const
+{
+  return 2;
+}
+void
+SpcAmsduSubframeHeader::Serialize (Buffer::Iterator i) const
+{
+  i.WriteHtolsbU16 (m_length);
+}
+uint32_t
+SpcAmsduSubframeHeader::Deserialize (Buffer::Iterator start)
+{
+  Buffer::Iterator i = start;
+  m_length = i.ReadLsbtohU16 ();
+  return i.GetDistanceFrom (start);
+}
+
+void
+SpcAmsduSubframeHeader::SetLength (uint16_t length)
+{
+  m_length = length;
+}
+uint16_t
+SpcAmsduSubframeHeader::GetLength (void) const
+{
+  return m_length;
+}
+
+} // namespace ns3
@@ -0,0 +1,56 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#ifndef SPC_AMSDU_SUBFRAME_HEADER_H
+#define SPC_AMSDU_SUBFRAME_HEADER_H
+
+#include "ns3/header.h"
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * Header in front of each packet carried in an aggregate data frame.
+ * The addresses of every subframe are those of the SpcMacHeader, so
+ * only the length of the packet is carried.
+ */
+class SpcAmsduSubframeHeader : public Header
+{
+public:
+  SpcAmsduSubframeHeader ();
+  ~SpcAmsduSubframeHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual void Print (std::ostream &os) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+
+  void SetLength (uint16_t length);
+  uint16_t GetLength (void) const;
+
+private:
+  uint16_t m_length;
+};
+
+} // namespace ns3
+
+#endif /* SPC_AMSDU_SUBFRAME_HEADER_H */
@@ -0,0 +1,100 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#include "spc-capacity.h"
+#include <cmath>
+#include <cstring>
+
+namespace ns3 {
+
+SpcCapacity::SpcCapacity ()
+  : m_mode (EXACT)
+{
+}
+
+void
+SpcCapacity::SetMode (Log2Mode mode)
+{
+  m_mode = mode;
+}
+
+SpcCapacity::Log2Mode
+SpcCapacity::GetMode (void) const
+{
+  return m_mode;
+}
+
+double
+SpcCapacity::FastLog2 (double x)
+{
+  // x = m * 2^e with m in [1, 2)
+  uint64_t bits;
+  std::memcpy (&bits, &x, sizeof (bits));
+  double e = (double)((int64_t)((bits >> 52) & 0x7ff) - 1023);
+  bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+  double m;
+  std::memcpy (&m, &bits, sizeof (m));
+  // fold m into [sqrt(1/2), sqrt(2)) to keep z small
+  bool fold = m > 1.4142135623730951;
+  m = fold ? m * 0.5 : m;
+  e = fold ? e + 1 : e;
+  // ln (m) = 2 atanh (z), z = (m - 1) / (m + 1), |z| < 0.172
+  double z = (m - 1) / (m + 1);
+  double z2 = z * z;
+  double ln = z * (2.0 + z2 * (2.0 / 3 + z2 * (2.0 / 5 + z2 * (2.0 / 7 + z2 * (2.0 / 9)))));
+  return e + ln * 1.4426950408889634;
+}
+
+double
+SpcCapacity::GetEfficiency (double snr) const
+{
+  if (m_mode == FAST)
+    {
+      return FastLog2 (1 + snr);
+    }
+  return log2 (1 + snr);
+}
+
+void
+SpcCapacity::GetEfficiency (const double *snr, double *efficiency, uint32_t n) const
+{
+  if (m_mode == FAST)
+    {
+      for (uint32_t i = 0; i < n; i++)
+        {
+          efficiency[i] = FastLog2 (1 + snr[i]);
+        }
+    }
+  else
+    {
+      for (uint32_t i = 0; i < n; i++)
+        {
+          efficiency[i] = log2 (1 + snr[i]);
+        }
+    }
+}
+
+double
+SpcCapacity::GetCapacity (uint32_t bandwidth, double snr) const
+{
+  return bandwidth * GetEfficiency (snr);
+}
+
+} // namespace ns3
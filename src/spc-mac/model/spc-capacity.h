@@ -0,0 +1,64 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#ifndef SPC_CAPACITY_H
+#define SPC_CAPACITY_H
+
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * Shannon capacity kernel shared by the MAC and the interference helper.
+ *
+ * EXACT uses libm log2.  FAST uses a polynomial log2 with a relative
+ * error below 1e-8 for arguments >= 1, written without branches so the
+ * batch call can be vectorized by the compiler.
+ */
+class SpcCapacity
+{
+public:
+  typedef enum Log2Mode
+  {
+    EXACT,
+    FAST
+  }Log2Mode;
+
+  SpcCapacity ();
+
+  void SetMode (Log2Mode mode);
+  Log2Mode GetMode (void) const;
+
+  /// log2 (1 + snr)
+  double GetEfficiency (double snr) const;
+  /// efficiency[i] = log2 (1 + snr[i]) for i < n
+  void GetEfficiency (const double *snr, double *efficiency, uint32_t n) const;
+  /// bandwidth * log2 (1 + snr) in bit/s
+  double GetCapacity (uint32_t bandwidth, double snr) const;
+
+  static double FastLog2 (double x);
+
+private:
+  Log2Mode m_mode;
+};
+
+} // namespace ns3
+
+#endif /* SPC_CAPACITY_H */
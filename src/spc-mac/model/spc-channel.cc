@@ -24,7 +24,13 @@
 #include "ns3/packet.h"
 #include "ns3/node.h"
 #include "ns3/log.h"
-#include "ns3/node.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/constant-position-mobility-model.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 NS_LOG_COMPONENT_DEFINE ("SpcChannel");
 
@@ -38,11 +44,96 @@ SpcChannel::GetTypeId (void)
   static TypeId tid = TypeId ("ns3::SpcChannel")
     .SetParent<Channel> ()
     .AddConstructor<SpcChannel> ()
+    .AddAttribute ("RangeCulling",
+                   "Only schedule receptions at phys inside the interference range of the sender. "
+                   "The loss model must be deterministic and decrease with distance.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&SpcChannel::m_rangeCulling),
+                   MakeBooleanChecker ())
+    .AddAttribute ("NegligibleRxPower",
+                   "Rx power (dBm) below which a frame can not affect a receiver when range culling is enabled.",
+                   DoubleValue (-120.0),
+                   MakeDoubleAccessor (&SpcChannel::m_negligibleRxPowerDbm),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("GridCellSize",
+                   "Edge length (m) of the cells of the spatial index used by range culling.",
+                   DoubleValue (100.0),
+                   MakeDoubleAccessor (&SpcChannel::m_gridCellSize),
+                   MakeDoubleChecker<double> (1.0))
+    .AddAttribute ("LinkCache",
+		   "Cache the path loss and the delay of every link until one of its ends moves. "
+		   "The loss model must be deterministic.",
+		   BooleanValue (false),
+		   MakeBooleanAccessor (&SpcChannel::m_linkCache),
+		   MakeBooleanChecker ())
+    .AddAttribute ("DenseLinkCacheLimit",
+		   "Largest number of phys for which the link cache is a dense matrix; "
+		   "above it a sparse map is used.",
+		   UintegerValue (256),
+		   MakeUintegerAccessor (&SpcChannel::m_denseLinkCacheLimit),
+		   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("LinkCacheLifetime",
+		   "Time after which a cached link is recomputed even if no CourseChange "
+		   "was reported. Zero keeps the entries until a CourseChange.",
+		   TimeValue (Seconds (0)),
+		   MakeTimeAccessor (&SpcChannel::m_linkCacheLifetime),
+		   MakeTimeChecker ())
+    .AddAttribute ("FanOut",
+		   "Schedule one event per transmission which walks its receivers in order of "
+		   "arrival and delivers those at the same distance together, instead of one "
+		   "event per receiver.",
+		   BooleanValue (false),
+		   MakeBooleanAccessor (&SpcChannel::m_fanOut),
+		   MakeBooleanChecker ())
+    .AddAttribute ("AdjacentChannelRejection",
+		   "Attenuation (dB) of a frame heard by a phy tuned to the adjacent channel. "
+		   "Such frames are only interference.",
+		   DoubleValue (16.0),
+		   MakeDoubleAccessor (&SpcChannel::m_adjacentChannelRejectionDb),
+		   MakeDoubleChecker<double> ())
+    .AddAttribute ("NonAdjacentChannelRejection",
+		   "Attenuation (dB) of a frame heard by a phy tuned two channel widths away. "
+		   "Phys further away do not hear the frame at all.",
+		   DoubleValue (32.0),
+		   MakeDoubleAccessor (&SpcChannel::m_nonAdjacentChannelRejectionDb),
+		   MakeDoubleChecker<double> ())
+    .AddAttribute ("BackgroundInterference",
+		   "Add frames received below BackgroundRxPower to the average background "
+		   "noise of the receiver instead of scheduling a reception.",
+		   BooleanValue (false),
+		   MakeBooleanAccessor (&SpcChannel::m_background),
+		   MakeBooleanChecker ())
+    .AddAttribute ("BackgroundRxPower",
+		   "Rx power (dBm) below which a frame only counts as background interference.",
+		   DoubleValue (-100.0),
+		   MakeDoubleAccessor (&SpcChannel::m_backgroundRxPowerDbm),
+		   MakeDoubleChecker<double> ())
+    .AddAttribute ("BatchRxPower",
+		   "Compute the rx power of all receivers of a transmission in one loop when the "
+		   "loss model is a LogDistancePropagationLossModel and the delay model a "
+		   "ConstantSpeedPropagationDelayModel. Not used together with the link cache.",
+		   BooleanValue (false),
+		   MakeBooleanAccessor (&SpcChannel::m_batchRxPower),
+		   MakeBooleanChecker ())
     ;
   return tid;
 }
   
+SpcChannel::Link::Link ()
+  : lossDb (0),
+    delay (Seconds (0)),
+    stamp (Seconds (0)),
+    txEpoch (0),
+    rxEpoch (0)
+{
+}
+
 SpcChannel::SpcChannel ()
+  : m_gridValid (false),
+    m_mobilityTracked (false),
+    m_linksValid (false),
+    m_batchSpeed (0),
+    m_fanOutEvents (0)
 {
   NS_LOG_FUNCTION (this);
 
@@ -57,16 +148,34 @@ SpcChannel::SpcChannel ()
   SetPropagationDelayModel (delay);
 }
 
+void
+SpcChannel::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_phyList.clear ();
+  m_phyIndex.clear ();
+  m_grid.clear ();
+  m_mobilityIndex.clear ();
+  m_denseLinks.clear ();
+  m_sparseLinks.clear ();
+  m_loss = 0;
+  m_delay = 0;
+  Channel::DoDispose ();
+}
+
 void
 SpcChannel::SetPropagationLossModel (Ptr<PropagationLossModel> loss)
 {
   m_loss = loss;
+  m_rangeCache.clear ();
+  m_linksValid = false;
 }
 
 void
 SpcChannel::SetPropagationDelayModel (Ptr<PropagationDelayModel> delay)
 {
   m_delay = delay;
+  m_linksValid = false;
 }
 
 uint32_t
@@ -85,96 +194,529 @@ SpcChannel::GetDevice (uint32_t i) const
 void
 SpcChannel::Add (Ptr<SpcPhy> phy)
 {
+  m_phyIndex[PeekPointer (phy)] = m_phyList.size ();
   m_phyList.push_back (phy);
+  m_gridValid = false;
+  m_mobilityTracked = false;
+  m_linksValid = false;
+}
+
+double
+SpcChannel::GetInterferenceRange (double txPowerDbm)
+{
+  std::map<double, double>::const_iterator it = m_rangeCache.find (txPowerDbm);
+  if (it != m_rangeCache.end ())
+    {
+      return it->second;
+    }
+
+  Ptr<ConstantPositionMobilityModel> a = CreateObject<ConstantPositionMobilityModel> ();
+  Ptr<ConstantPositionMobilityModel> b = CreateObject<ConstantPositionMobilityModel> ();
+  double lo = 0;
+  double hi = m_gridCellSize;
+  b->SetPosition (Vector (hi, 0, 0));
+  while (m_loss->CalcRxPower (txPowerDbm, a, b) >= m_negligibleRxPowerDbm)
+    {
+      lo = hi;
+      hi *= 2;
+      if (hi > 1e7)
+	{
+	  // the loss model never reaches the cutoff: do not cull
+	  hi = std::numeric_limits<double>::infinity ();
+	  break;
+	}
+      b->SetPosition (Vector (hi, 0, 0));
+    }
+  for (uint32_t k = 0; k < 20 && hi - lo > 1.0 && hi < std::numeric_limits<double>::infinity (); k++)
+    {
+      double mid = (lo + hi) / 2;
+      b->SetPosition (Vector (mid, 0, 0));
+      if (m_loss->CalcRxPower (txPowerDbm, a, b) >= m_negligibleRxPowerDbm)
+	{
+	  lo = mid;
+	}
+      else
+	{
+	  hi = mid;
+	}
+    }
+  NS_LOG_DEBUG ("txPower=" << txPowerDbm << ", interference range=" << hi);
+  m_rangeCache[txPowerDbm] = hi;
+  return hi;
+}
+
+SpcChannel::Cell
+SpcChannel::GetCell (const Vector &position) const
+{
+  return Cell (static_cast<int32_t> (std::floor (position.x / m_gridCellSize)),
+	       static_cast<int32_t> (std::floor (position.y / m_gridCellSize)));
+}
+
+void
+SpcChannel::BuildGrid (void)
+{
+  NS_LOG_FUNCTION (this);
+  TrackMobility ();
+  m_grid.clear ();
+  m_phyCell.assign (m_phyList.size (), Cell (0, 0));
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      Ptr<MobilityModel> mobility = m_phyList[j]->GetMobility ()->GetObject<MobilityModel> ();
+      m_phyCell[j] = GetCell (mobility->GetPosition ());
+      m_grid[m_phyCell[j]].push_back (j);
+    }
+  m_gridValid = true;
+}
+
+void
+SpcChannel::TrackMobility (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_epoch.resize (m_phyList.size (), 1);
+  // the entries stay connected to CourseChange, only their phys are rebuilt
+  for (std::map<const MobilityModel *, std::vector<uint32_t> >::iterator i = m_mobilityIndex.begin ();
+       i != m_mobilityIndex.end (); i++)
+    {
+      i->second.clear ();
+    }
+  for (uint32_t j = 0; j < m_phyList.size (); j++)
+    {
+      Ptr<MobilityModel> mobility = m_phyList[j]->GetMobility ()->GetObject<MobilityModel> ();
+      std::map<const MobilityModel *, std::vector<uint32_t> >::iterator it = m_mobilityIndex.find (PeekPointer (mobility));
+      if (it == m_mobilityIndex.end ())
+	{
+	  mobility->TraceConnectWithoutContext ("CourseChange",
+						MakeCallback (&SpcChannel::CourseChanged, this));
+	  it = m_mobilityIndex.insert (std::make_pair (PeekPointer (mobility), std::vector<uint32_t> ())).first;
+	}
+      it->second.push_back (j);
+    }
+  m_mobilityTracked = true;
+}
+
+void
+SpcChannel::CourseChanged (Ptr<const MobilityModel> mobility)
+{
+  std::map<const MobilityModel *, std::vector<uint32_t> >::const_iterator it = m_mobilityIndex.find (PeekPointer (mobility));
+  if (it == m_mobilityIndex.end () || it->second.empty ())
+    {
+      return;
+    }
+  for (std::vector<uint32_t>::const_iterator k = it->second.begin (); k != it->second.end (); k++)
+    {
+      m_epoch[*k]++;
+    }
+  if (!m_gridValid)
+    {
+      return;
+    }
+  Cell cell = GetCell (mobility->GetPosition ());
+  for (std::vector<uint32_t>::const_iterator k = it->second.begin (); k != it->second.end (); k++)
+    {
+      uint32_t j = *k;
+      if (cell == m_phyCell[j])
+	{
+	  continue;
+	}
+      std::vector<uint32_t> &old = m_grid[m_phyCell[j]];
+      old.erase (std::find (old.begin (), old.end (), j));
+      m_grid[cell].push_back (j);
+      m_phyCell[j] = cell;
+    }
+}
+
+void
+SpcChannel::GetLink (uint32_t sender, uint32_t receiver, Ptr<MobilityModel> senderMobility,
+		     double txPowerDbm, double *rxPowerDbm, Time *delay)
+{
+  if (!m_linkCache)
+    {
+      Ptr<MobilityModel> receiverMobility = m_phyList[receiver]->GetMobility ()->GetObject<MobilityModel> ();
+      *rxPowerDbm = m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
+      *delay = m_delay->GetDelay (senderMobility, receiverMobility);
+      return;
+    }
+
+  uint32_t n = m_phyList.size ();
+  if (!m_linksValid)
+    {
+      if (!m_mobilityTracked)
+	{
+	  TrackMobility ();
+	}
+      m_denseLinks.clear ();
+      m_sparseLinks.clear ();
+      if (n <= m_denseLinkCacheLimit)
+	{
+	  m_denseLinks.resize (n * n);
+	}
+      m_linksValid = true;
+    }
+
+  Link *link;
+  if (!m_denseLinks.empty ())
+    {
+      link = &m_denseLinks[sender * n + receiver];
+    }
+  else
+    {
+      link = &m_sparseLinks[(static_cast<uint64_t> (sender) << 32) | receiver];
+    }
+  if (link->txEpoch != m_epoch[sender] || link->rxEpoch != m_epoch[receiver] ||
+      (!m_linkCacheLifetime.IsZero () && Simulator::Now () >= link->stamp + m_linkCacheLifetime))
+    {
+      // the loss models are linear in the tx power, so the loss in dB
+      // can be reused for any tx power of the sender
+      Ptr<MobilityModel> receiverMobility = m_phyList[receiver]->GetMobility ()->GetObject<MobilityModel> ();
+      link->lossDb = txPowerDbm - m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
+      link->delay = m_delay->GetDelay (senderMobility, receiverMobility);
+      link->stamp = Simulator::Now ();
+      link->txEpoch = m_epoch[sender];
+      link->rxEpoch = m_epoch[receiver];
+    }
+  *rxPowerDbm = txPowerDbm - link->lossDb;
+  *delay = link->delay;
+}
+
+void
+SpcChannel::GetReceivers (uint32_t sender, Ptr<MobilityModel> senderMobility, double txPowerDbm, std::vector<uint32_t> *receivers)
+{
+  receivers->clear ();
+  double range = m_rangeCulling ? GetInterferenceRange (txPowerDbm) : 0;
+  if (!m_rangeCulling || range == std::numeric_limits<double>::infinity ())
+    {
+      for (uint32_t j = 0; j < m_phyList.size (); j++)
+	{
+	  if (j != sender)
+	    {
+	      receivers->push_back (j);
+	    }
+	}
+      return;
+    }
+
+  if (!m_gridValid)
+    {
+      BuildGrid ();
+    }
+  Cell center = GetCell (senderMobility->GetPosition ());
+  int32_t reach = static_cast<int32_t> (std::ceil (range / m_gridCellSize));
+  for (int32_t x = center.first - reach; x <= center.first + reach; x++)
+    {
+      for (int32_t y = center.second - reach; y <= center.second + reach; y++)
+	{
+	  Grid::const_iterator cell = m_grid.find (Cell (x, y));
+	  if (cell == m_grid.end ())
+	    {
+	      continue;
+	    }
+	  for (std::vector<uint32_t>::const_iterator k = cell->second.begin (); k != cell->second.end (); k++)
+	    {
+	      if (*k != sender)
+		{
+		  receivers->push_back (*k);
+		}
+	    }
+	}
+    }
+  // keep the delivery order of the exhaustive loop
+  std::sort (receivers->begin (), receivers->end ());
 }
   
 void
-SpcChannel::Send (Ptr<Packet> packet, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender) const
+SpcChannel::Send (Ptr<const Packet> packet, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender)
+{
+  NS_LOG_FUNCTION (this);
+  ScheduleReceptions (packet, 0, preamble, txPowerDbm, sender);
+}
+
+void
+SpcChannel::Send (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender)
 {
   NS_LOG_FUNCTION (this);
+  ScheduleReceptions (packet1, packet2, preamble, txPowerDbm, sender);
+}
+
+bool
+SpcChannel::CalcBatchLinks (Ptr<MobilityModel> senderMobility, double txPowerDbm)
+{
+  // only the plain log-distance / constant-speed pair has a closed form
+  // which can be evaluated here; anything else goes through the models
+  if (m_loss->GetInstanceTypeId () != LogDistancePropagationLossModel::GetTypeId ()
+      || m_loss->GetNext () != 0
+      || m_delay->GetInstanceTypeId () != ConstantSpeedPropagationDelayModel::GetTypeId ())
+    {
+      return false;
+    }
+  DoubleValue exponent;
+  DoubleValue referenceDistance;
+  DoubleValue referenceLoss;
+  DoubleValue speed;
+  m_loss->GetAttribute ("Exponent", exponent);
+  m_loss->GetAttribute ("ReferenceDistance", referenceDistance);
+  m_loss->GetAttribute ("ReferenceLoss", referenceLoss);
+  m_delay->GetAttribute ("Speed", speed);
+  m_batchSpeed = speed.Get ();
+
+  uint32_t n = m_receivers.size ();
+  m_batchX.resize (n);
+  m_batchY.resize (n);
+  m_batchZ.resize (n);
+  m_batchDistance.resize (n);
+  m_batchRxPowerDbm.resize (n);
+  for (uint32_t k = 0; k < n; k++)
+    {
+      Vector position = m_phyList[m_receivers[k]]->GetMobility ()->GetObject<MobilityModel> ()->GetPosition ();
+      m_batchX[k] = position.x;
+      m_batchY[k] = position.y;
+      m_batchZ[k] = position.z;
+    }
+
+  Vector origin = senderMobility->GetPosition ();
+  const double x0 = origin.x;
+  const double y0 = origin.y;
+  const double z0 = origin.z;
+  const double d0 = referenceDistance.Get ();
+  const double factor = 10 * exponent.Get ();
+  const double offset = txPowerDbm - referenceLoss.Get () + factor * std::log10 (d0);
+  const double *x = &m_batchX[0];
+  const double *y = &m_batchY[0];
+  const double *z = &m_batchZ[0];
+  double *distance = &m_batchDistance[0];
+  double *rxPowerDbm = &m_batchRxPowerDbm[0];
+  // no branches and no aliasing: the compiler can vectorize this loop
+  for (uint32_t k = 0; k < n; k++)
+    {
+      double dx = x[k] - x0;
+      double dy = y[k] - y0;
+      double dz = z[k] - z0;
+      distance[k] = std::sqrt (dx * dx + dy * dy + dz * dz);
+      rxPowerDbm[k] = offset - factor * std::log10 (distance[k]);
+    }
+  // inside the reference distance the model has its own rule
+  for (uint32_t k = 0; k < n; k++)
+    {
+      if (distance[k] <= d0)
+	{
+	  Ptr<MobilityModel> receiverMobility = m_phyList[m_receivers[k]]->GetMobility ()->GetObject<MobilityModel> ();
+	  rxPowerDbm[k] = m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
+	}
+    }
+  return true;
+}
+
+bool
+SpcChannel::GetChannelRejection (Ptr<SpcPhy> sender, Ptr<SpcPhy> receiver, double *rejectionDb) const
+{
+  double separation = std::abs ((double)sender->GetFrequency () - (double)receiver->GetFrequency ());
+  double width = (sender->GetChannelWidth () + receiver->GetChannelWidth ()) / 2.0;
+  if (separation < width)
+    {
+      *rejectionDb = 0;
+    }
+  else if (separation < 2 * width)
+    {
+      *rejectionDb = m_adjacentChannelRejectionDb;
+    }
+  else if (separation < 3 * width)
+    {
+      *rejectionDb = m_nonAdjacentChannelRejectionDb;
+    }
+  else
+    {
+      return false;
+    }
+  return true;
+}
+
+bool
+SpcChannel::ArrivesBefore (const Arrival &a, const Arrival &b)
+{
+  if (a.delay != b.delay)
+    {
+      return a.delay < b.delay;
+    }
+  return a.context < b.context;
+}
+
+void
+SpcChannel::ScheduleReceptions (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble,
+				double txPowerDbm, Ptr<SpcPhy> sender)
+{
   Ptr<MobilityModel> senderMobility = sender->GetMobility ()->GetObject<MobilityModel> ();
-  uint32_t j = 0;
-  for (PhyList::const_iterator i = m_phyList.begin (); i != m_phyList.end (); i++, j++)
+  uint32_t senderIndex = m_phyIndex[PeekPointer (sender)];
+  GetReceivers (senderIndex, senderMobility, txPowerDbm, &m_receivers);
+
+  Ptr<Transmission> tx;
+  if (m_fanOut)
     {
-      if (sender == (*i))
+      tx = Create<Transmission> ();
+      tx->packet1 = packet1;
+      tx->packet2 = packet2;
+      tx->preamble = preamble;
+      tx->arrivals.reserve (m_receivers.size ());
+    }
+  Time duration;
+  if (m_background)
+    {
+      // same as the rx duration computed by SpcPhy::StartReceive
+      uint32_t size = packet2 == 0 ? packet1->GetSize () : preamble.GetSymbols ();
+      duration = Seconds ((double)size / preamble.GetRate ()) + preamble.GetDuration ();
+    }
+  bool batch = !m_linkCache && m_batchRxPower && CalcBatchLinks (senderMobility, txPowerDbm);
+  for (uint32_t k = 0; k < m_receivers.size (); k++)
+    {
+      uint32_t j = m_receivers[k];
+      double rxPowerDbm;
+      Time delay;
+      if (batch)
+	{
+	  rxPowerDbm = m_batchRxPowerDbm[k];
+	  delay = Seconds (m_batchDistance[k] / m_batchSpeed);
+	}
+      else
+	{
+	  GetLink (senderIndex, j, senderMobility, txPowerDbm, &rxPowerDbm, &delay);
+	}
+      double rejectionDb;
+      if (!GetChannelRejection (sender, m_phyList[j], &rejectionDb))
 	{
 	  continue;
 	}
-      Ptr<MobilityModel> receiverMobility = (*i)->GetMobility ()->GetObject<MobilityModel> ();
-      Time delay = m_delay->GetDelay (senderMobility, receiverMobility);
-      double rxPowerDbm = m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
-      Ptr<Packet> copy = packet->Copy ();
-      Ptr<Object> dstNetDevice = m_phyList[j]->GetDevice ();
-      uint32_t dstNode;
-      if (dstNetDevice == 0)
+      rxPowerDbm -= rejectionDb;
+      if (m_rangeCulling && rxPowerDbm < m_negligibleRxPowerDbm)
 	{
-	  dstNode = 0xffffffff;
+	  continue;
 	}
-      else
+      if (m_background && rxPowerDbm < m_backgroundRxPowerDbm)
 	{
-	  dstNode = dstNetDevice->GetObject<NetDevice> ()->GetNode ()->GetId ();
+	  m_phyList[j]->AddBackgroundInterference (rxPowerDbm, Simulator::Now () + delay, duration);
+	  continue;
 	}
       NS_LOG_DEBUG ("rxPower=" << rxPowerDbm << ", delay=" << delay);
-      Simulator::ScheduleWithContext (dstNode,
-				      delay,
-				      &SpcChannel::Receive,
-				      this,
-				      copy,
-				      preamble,
-				      rxPowerDbm,
-				      j);
+      if (m_fanOut)
+	{
+	  Arrival arrival;
+	  arrival.delay = delay;
+	  arrival.rxPowerDbm = rxPowerDbm;
+	  arrival.receiver = j;
+	  arrival.context = GetContext (j);
+	  tx->arrivals.push_back (arrival);
+	  continue;
+	}
+      uint32_t dstNode = GetContext (j);
+      if (packet2 == 0)
+	{
+	  Simulator::ScheduleWithContext (dstNode,
+					  delay,
+					  &SpcChannel::Receive,
+					  this,
+					  packet1,
+					  preamble,
+					  rxPowerDbm,
+					  j);
+	}
+      else
+	{
+	  Simulator::ScheduleWithContext (dstNode,
+					  delay,
+					  &SpcChannel::Receive2,
+					  this,
+					  packet1,
+					  packet2,
+					  preamble,
+					  rxPowerDbm,
+					  j);
+	}
+    }
+  if (m_fanOut)
+    {
+      // stable: receivers at the same distance keep the order of the
+      // per-receiver events
+      std::stable_sort (tx->arrivals.begin (), tx->arrivals.end (), &SpcChannel::ArrivesBefore);
+      if (!tx->arrivals.empty ())
+	{
+	  m_fanOutEvents++;
+	  Simulator::Schedule (tx->arrivals[0].delay, &SpcChannel::FanOut, this, tx, 0);
+	}
+    }
+}
+
+uint32_t
+SpcChannel::GetContext (uint32_t i) const
+{
+  Ptr<Object> device = m_phyList[i]->GetDevice ();
+  if (device == 0)
+    {
+      return 0xffffffff;
     }
+  return device->GetObject<NetDevice> ()->GetNode ()->GetId ();
 }
 
 void
-SpcChannel::Send (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender) const
+SpcChannel::FanOut (Ptr<Transmission> tx, uint32_t next)
 {
   NS_LOG_FUNCTION (this);
-  Ptr<MobilityModel> senderMobility = sender->GetMobility ()->GetObject<MobilityModel> ();
-  uint32_t j = 0;
-  for (PhyList::const_iterator i = m_phyList.begin (); i != m_phyList.end (); i++, j++)
+  Time delay = tx->arrivals[next].delay;
+  while (next < tx->arrivals.size () && tx->arrivals[next].delay == delay)
     {
-      if (sender == (*i))
+      uint32_t context = tx->arrivals[next].context;
+      uint32_t end = next;
+      while (end < tx->arrivals.size () && tx->arrivals[end].delay == delay && tx->arrivals[end].context == context)
 	{
-	  continue;
+	  end++;
 	}
-      Ptr<MobilityModel> receiverMobility = (*i)->GetMobility ()->GetObject<MobilityModel> ();
-      Time delay = m_delay->GetDelay (senderMobility, receiverMobility);
-      double rxPowerDbm = m_loss->CalcRxPower (txPowerDbm, senderMobility, receiverMobility);
-      Ptr<Packet> copy1 = packet1->Copy ();
-      Ptr<Packet> copy2 = packet2->Copy ();
-      Ptr<Object> dstNetDevice = m_phyList[j]->GetDevice ();
-      uint32_t dstNode;
-      if (dstNetDevice == 0)
+      // receptions run in the context of the receiver as they do
+      // without fan-out
+      if (context == Simulator::GetContext ())
 	{
-	  dstNode = 0xffffffff;
+	  Deliver (tx, next, end);
 	}
       else
 	{
-	  dstNode = dstNetDevice->GetObject<NetDevice> ()->GetNode ()->GetId ();
+	  Simulator::ScheduleWithContext (context, Seconds (0), &SpcChannel::Deliver, this, tx, next, end);
 	}
-      NS_LOG_DEBUG ("rxPower=" << rxPowerDbm << ", delay=" << delay);
-      Simulator::ScheduleWithContext (dstNode,
-				      delay,
-				      &SpcChannel::Receive2,
-				      this,
-				      copy1,
-				      copy2,
-				      preamble,
-				      rxPowerDbm,
-				      j);
+      next = end;
+    }
+  if (next < tx->arrivals.size ())
+    {
+      m_fanOutEvents++;
+      Simulator::Schedule (tx->arrivals[next].delay - delay, &SpcChannel::FanOut, this, tx, next);
     }
 }
 
 void
-SpcChannel::Receive (Ptr<Packet> packet, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const
+SpcChannel::Deliver (Ptr<Transmission> tx, uint32_t begin, uint32_t end)
+{
+  for (uint32_t i = begin; i < end; i++)
+    {
+      const Arrival &arrival = tx->arrivals[i];
+      if (tx->packet2 == 0)
+	{
+	  Receive (tx->packet1, tx->preamble, arrival.rxPowerDbm, arrival.receiver);
+	}
+      else
+	{
+	  Receive2 (tx->packet1, tx->packet2, tx->preamble, arrival.rxPowerDbm, arrival.receiver);
+	}
+    }
+}
+
+uint64_t
+SpcChannel::GetFanOutEvents (void) const
+{
+  return m_fanOutEvents;
+}
+
+void
+SpcChannel::Receive (Ptr<const Packet> packet, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const
 {
   NS_LOG_FUNCTION (this);
   m_phyList[i]->StartReceive (packet, preamble, rxPowerDbm);
 }
 
 void
-SpcChannel::Receive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const
+SpcChannel::Receive2 (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const
 {
   NS_LOG_FUNCTION (this);
   m_phyList[i]->StartReceive (packet1, packet2, preamble, rxPowerDbm);
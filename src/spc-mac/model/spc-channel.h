@@ -26,7 +26,11 @@
 #include "ns3/propagation-loss-model.h"
 #include "ns3/propagation-delay-model.h"
 #include "ns3/mobility-model.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/nstime.h"
 #include <vector>
+#include <map>
+#include <utility>
 
 #include "spc-preamble.h"
 #include "spc-channel.h"
@@ -53,16 +57,156 @@ public:
   virtual uint32_t GetNDevices (void) const;
   virtual Ptr<NetDevice> GetDevice (uint32_t i) const;
 
-  void Send (Ptr<Packet> packet, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender) const; 
-  void Send (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender) const; 
-  void Receive (Ptr<Packet> packet, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const;
-  void Receive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const;
+  void Send (Ptr<const Packet> packet, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender);
+  void Send (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble, double txPowerDbm, Ptr<SpcPhy> sender);
+  void Receive (Ptr<const Packet> packet, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const;
+  void Receive2 (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble, double rxPowerDbm, uint32_t i) const;
+
+  /// Number of fan-out walker events scheduled so far
+  uint64_t GetFanOutEvents (void) const;
+
+protected:
+  virtual void DoDispose (void);
 
 private:
   typedef std::vector<Ptr<SpcPhy> > PhyList;
+  typedef std::pair<int32_t, int32_t> Cell;
+  typedef std::map<Cell, std::vector<uint32_t> > Grid;
+
+  /**
+   * Collect the indices of the phys which may hear a frame sent by
+   * sender, in ascending order.  Without range culling this is every
+   * phy except the sender; with it only the phys in the grid cells
+   * inside the interference range are returned.
+   */
+  void GetReceivers (uint32_t sender, Ptr<MobilityModel> senderMobility, double txPowerDbm, std::vector<uint32_t> *receivers);
+  /// Distance beyond which the rx power falls below m_negligibleRxPowerDbm
+  double GetInterferenceRange (double txPowerDbm);
+  Cell GetCell (const Vector &position) const;
+  void BuildGrid (void);
+  /// Connect to the CourseChange trace of every phy not yet tracked
+  void TrackMobility (void);
+  void CourseChanged (Ptr<const MobilityModel> mobility);
+  /**
+   * Rx power and propagation delay from phy sender to phy receiver,
+   * served from the link cache when it is enabled and still valid.
+   */
+  void GetLink (uint32_t sender, uint32_t receiver, Ptr<MobilityModel> senderMobility,
+                double txPowerDbm, double *rxPowerDbm, Time *delay);
+
+  /**
+   * Cached path loss and delay of one (sender, receiver) pair.  The
+   * entry is valid while both epochs match the current epochs of the
+   * two phys; a CourseChange bumps the epoch of every phy of the
+   * mobility model.  Phys moving at constant velocity do not report a
+   * CourseChange, so for slow-moving topologies entries also expire
+   * after m_linkCacheLifetime.
+   */
+  struct Link
+  {
+    Link ();
+    double lossDb;
+    Time delay;
+    Time stamp;
+    uint32_t txEpoch;
+    uint32_t rxEpoch;
+  };
+
+  /// Arrival of a frame at one receiver, relative to the start of the transmission
+  struct Arrival
+  {
+    Time delay;
+    double rxPowerDbm;
+    uint32_t receiver;
+    /// node of the receiver, whose context the reception runs in
+    uint32_t context;
+  };
+  /**
+   * Rx power and distance of every phy in m_receivers, computed in one
+   * loop over structure-of-arrays positions.  Returns false, leaving the
+   * buffers untouched, when the propagation models are not the plain
+   * log-distance and constant-speed models.
+   */
+  bool CalcBatchLinks (Ptr<MobilityModel> senderMobility, double txPowerDbm);
+  /**
+   * Attenuation of a frame from sender at receiver due to the distance
+   * between their channels.  Returns false when the channels are far
+   * enough apart for the frame not to be heard at all.
+   */
+  bool GetChannelRejection (Ptr<SpcPhy> sender, Ptr<SpcPhy> receiver, double *rejectionDb) const;
+  /// Order of fan-out delivery: by delay, then by node
+  static bool ArrivesBefore (const Arrival &a, const Arrival &b);
+  /// Node id of the device of phy i, or 0xffffffff when it has none
+  uint32_t GetContext (uint32_t i) const;
+  /**
+   * One transmission in fan-out mode.  The arrivals are sorted by
+   * ArrivesBefore.  packet2 is null for a normal frame.
+   */
+  class Transmission : public SimpleRefCount<Transmission>
+  {
+  public:
+    Ptr<const Packet> packet1;
+    Ptr<const Packet> packet2;
+    SpcPreamble preamble;
+    std::vector<Arrival> arrivals;
+  };
+
+  /**
+   * Hand the frame to every phy which may hear it, either with one
+   * event per receiver or, in fan-out mode, with one walker event per
+   * transmission.
+   */
+  void ScheduleReceptions (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble,
+                           double txPowerDbm, Ptr<SpcPhy> sender);
+  /**
+   * Deliver the arrivals of tx from next on which are due now, each
+   * node in its own context, and re-arm for the next ones
+   */
+  void FanOut (Ptr<Transmission> tx, uint32_t next);
+  /// Deliver the arrivals [begin, end) of tx, all at the same node
+  void Deliver (Ptr<Transmission> tx, uint32_t begin, uint32_t end);
+
   PhyList m_phyList;
+  std::map<const SpcPhy *, uint32_t> m_phyIndex;
   Ptr<PropagationLossModel> m_loss;
   Ptr<PropagationDelayModel> m_delay;
+
+  bool m_rangeCulling;
+  double m_negligibleRxPowerDbm;
+  double m_gridCellSize;
+  bool m_gridValid;
+  Grid m_grid;
+  std::vector<Cell> m_phyCell;
+  /// phys of each mobility model, several when a node has several phys
+  std::map<const MobilityModel *, std::vector<uint32_t> > m_mobilityIndex;
+  bool m_mobilityTracked;
+
+  bool m_linkCache;
+  uint32_t m_denseLinkCacheLimit;
+  Time m_linkCacheLifetime;
+  bool m_linksValid;
+  std::vector<uint32_t> m_epoch;
+  std::vector<Link> m_denseLinks;
+  std::map<uint64_t, Link> m_sparseLinks;
+  std::map<double, double> m_rangeCache;
+  std::vector<uint32_t> m_receivers;
+
+  double m_adjacentChannelRejectionDb;
+  double m_nonAdjacentChannelRejectionDb;
+
+  bool m_background;
+  double m_backgroundRxPowerDbm;
+
+  bool m_batchRxPower;
+  double m_batchSpeed;
+  std::vector<double> m_batchX;
+  std::vector<double> m_batchY;
+  std::vector<double> m_batchZ;
+  std::vector<double> m_batchDistance;
+  std::vector<double> m_batchRxPowerDbm;
+
+  bool m_fanOut;
+  uint64_t m_fanOutEvents;
 };
 
 } // namespace ns3
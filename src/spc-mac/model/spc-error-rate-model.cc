@@ -0,0 +1,99 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#include "spc-error-rate-model.h"
+#include "ns3/log.h"
+#include <cmath>
+
+NS_LOG_COMPONENT_DEFINE ("SpcErrorRateModel");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (SpcErrorRateModel);
+NS_OBJECT_ENSURE_REGISTERED (SpcShannonErrorRateModel);
+
+TypeId
+SpcErrorRateModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SpcErrorRateModel")
+    .SetParent<Object> ()
+    ;
+  return tid;
+}
+
+bool
+SpcErrorRateModel::GetCapacityThreshold (const SpcPreamble &preamble, uint64_t nbytes,
+                                         Time duration, double *threshold) const
+{
+  return false;
+}
+
+TypeId
+SpcShannonErrorRateModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SpcShannonErrorRateModel")
+    .SetParent<SpcErrorRateModel> ()
+    .AddConstructor<SpcShannonErrorRateModel> ()
+    ;
+  return tid;
+}
+
+double
+SpcShannonErrorRateModel::GetChunkSuccessRate (const SpcPreamble &preamble, double efficiency,
+                                               uint64_t nbytes, Time duration) const
+{
+  uint64_t shannonBits = preamble.GetBandwidth () * efficiency;
+  uint64_t shannonBytes = shannonBits / 8;
+  shannonBytes = shannonBytes * duration.GetSeconds ();
+
+  NS_LOG_DEBUG ("[Slimit]: " << shannonBytes << ", [Bytes]:" << nbytes);
+
+  if (shannonBytes >= nbytes)
+    {
+      return 1;
+    }
+  else
+    {
+      return 0;
+    }
+}
+
+bool
+SpcShannonErrorRateModel::GetCapacityThreshold (const SpcPreamble &preamble, uint64_t nbytes,
+                                                Time duration, double *threshold) const
+{
+  // fewest bytes per second which cover nbytes, rounded as in
+  // GetChunkSuccessRate
+  double seconds = duration.GetSeconds ();
+  uint64_t bytes = (uint64_t)std::ceil (nbytes / seconds);
+  while (bytes > 0 && (uint64_t)((bytes - 1) * seconds) >= nbytes)
+    {
+      bytes--;
+    }
+  while ((uint64_t)(bytes * seconds) < nbytes)
+    {
+      bytes++;
+    }
+  // the whole bits of bandwidth * efficiency must cover them
+  *threshold = 8.0 * bytes;
+  return true;
+}
+
+} // namespace ns3
@@ -0,0 +1,78 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#ifndef SPC_ERROR_RATE_MODEL_H
+#define SPC_ERROR_RATE_MODEL_H
+
+#include <stdint.h>
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "spc-preamble.h"
+
+namespace ns3 {
+
+/**
+ * Decides how likely a chunk of a frame, received at a constant SINR,
+ * is to be decoded.  SpcInterferenceHelper splits every frame into such
+ * chunks and multiplies their success rates.
+ */
+class SpcErrorRateModel : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  /**
+   * \param preamble preamble of the frame (rate and bandwidth)
+   * \param efficiency log2 (1 + SINR) of the chunk
+   * \param nbytes number of bytes sent during the chunk
+   * \param duration length of the chunk
+   * \return probability that the chunk is received
+   */
+  virtual double GetChunkSuccessRate (const SpcPreamble &preamble, double efficiency,
+                                      uint64_t nbytes, Time duration) const = 0;
+  /**
+   * For a model whose success rate is either 0 or 1: the chunk is
+   * received iff bandwidth * efficiency >= *threshold, so a chunk at a
+   * constant SINR is decided with one comparison.
+   *
+   * \return false, the default, if the success rate may lie in between
+   */
+  virtual bool GetCapacityThreshold (const SpcPreamble &preamble, uint64_t nbytes,
+                                     Time duration, double *threshold) const;
+};
+
+/**
+ * The chunk is received if the Shannon capacity of the channel over the
+ * chunk covers the bytes sent during it.
+ */
+class SpcShannonErrorRateModel : public SpcErrorRateModel
+{
+public:
+  static TypeId GetTypeId (void);
+
+  virtual double GetChunkSuccessRate (const SpcPreamble &preamble, double efficiency,
+                                      uint64_t nbytes, Time duration) const;
+  virtual bool GetCapacityThreshold (const SpcPreamble &preamble, uint64_t nbytes,
+                                     Time duration, double *threshold) const;
+};
+
+} // namespace ns3
+
+#endif /* SPC_ERROR_RATE_MODEL_H */
@@ -41,6 +41,8 @@
 #include "ns3/simulator.h"
 #include "ns3/log.h"
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include "ns3/math.h"
 
 NS_LOG_COMPONENT_DEFINE ("SpcInterferenceHelper");
@@ -51,19 +53,23 @@ namespace ns3 {
  *       Phy event class
  ****************************************************************/
 
-SpcInterferenceHelper::Event::Event (uint32_t size, Time duration, double rxPower, SpcPreamble preamble)
-  : m_size (size),
-    m_startTime (Simulator::Now ()),
-    m_endTime (m_startTime + duration),
-    m_rxPowerW (rxPower),
-    m_preamble (preamble)
-    
+SpcInterferenceHelper::Event::Event (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble)
 {
+  Init (size, duration, rxPower, preamble);
 }
 SpcInterferenceHelper::Event::~Event ()
 {
 }
 
+void
+SpcInterferenceHelper::Event::Init (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble)
+{
+  m_size = size;
+  m_startTime = Simulator::Now ();
+  m_endTime = m_startTime + duration;
+  m_rxPowerW = rxPower;
+  m_preamble = preamble;
+}
 Time
 SpcInterferenceHelper::Event::GetDuration (void) const
 {
@@ -89,12 +95,69 @@ SpcInterferenceHelper::Event::GetSize (void) const
 {
   return m_size;
 }
-SpcPreamble
+const SpcPreamble &
 SpcInterferenceHelper::Event::GetPreamble (void) const
 {
   return m_preamble;
 }
 
+void
+SpcInterferenceHelper::EventDeleter::Delete (Event *event)
+{
+  if (event->m_pool == 0)
+    {
+      delete event;
+      return;
+    }
+  // the pool may be freed with its last event, so keep it alive until
+  // the event is back on its free list
+  Ptr<EventPool> pool = event->m_pool;
+  event->m_pool = 0;
+  pool->Release (event);
+}
+
+SpcInterferenceHelper::EventPool::EventPool ()
+  : m_allocations (0)
+{
+}
+SpcInterferenceHelper::EventPool::~EventPool ()
+{
+  for (std::vector<Event *>::iterator i = m_free.begin (); i != m_free.end (); i++)
+    {
+      delete *i;
+    }
+  m_free.clear ();
+}
+
+Ptr<SpcInterferenceHelper::Event>
+SpcInterferenceHelper::EventPool::Allocate (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble)
+{
+  Event *event;
+  if (m_free.empty ())
+    {
+      event = new Event (size, duration, rxPower, preamble);
+      event->m_pool = this;
+      m_allocations++;
+      // a new event already holds one reference
+      return Ptr<Event> (event, false);
+    }
+  event = m_free.back ();
+  m_free.pop_back ();
+  event->Init (size, duration, rxPower, preamble);
+  event->m_pool = this;
+  return Ptr<Event> (event);
+}
+void
+SpcInterferenceHelper::EventPool::Release (Event *event)
+{
+  m_free.push_back (event);
+}
+uint64_t
+SpcInterferenceHelper::EventPool::GetAllocations (void) const
+{
+  return m_allocations;
+}
+
 /****************************************************************
  *       Class which records SNIR change events for a
  *       short period of time.
@@ -126,9 +189,18 @@ SpcInterferenceHelper::NiChange::operator < (const SpcInterferenceHelper::NiChan
  ****************************************************************/
 
 SpcInterferenceHelper::SpcInterferenceHelper ()
-  : m_firstPower (0.0),
-    m_rxing (false)
-{
+  : m_eventPool (Create<EventPool> ()),
+    m_firstPower (0.0),
+    m_cursor (m_niChanges.end ()),
+    m_cursorPower (0.0),
+    m_rxing (false),
+    m_highWaterMark (0),
+    m_fastPath (0),
+    m_backgroundW (0.0),
+    m_backgroundStamp (Seconds (0)),
+    m_backgroundTau (MilliSeconds (10))
+{
+  SetErrorRateModel (0);
 }
 SpcInterferenceHelper::~SpcInterferenceHelper ()
 {
@@ -136,14 +208,14 @@ SpcInterferenceHelper::~SpcInterferenceHelper ()
 }
 
 Ptr<SpcInterferenceHelper::Event>
-SpcInterferenceHelper::Add (uint32_t size, Time duration, double rxPowerW, SpcPreamble preamble)
+SpcInterferenceHelper::Add (uint32_t size, Time duration, double rxPowerW, const SpcPreamble &preamble)
 {
   Ptr<SpcInterferenceHelper::Event> event;
 
-  event = Create<SpcInterferenceHelper::Event> (size,
-                                             duration,
-                                             rxPowerW,
-                                             preamble);
+  event = m_eventPool->Allocate (size,
+                                 duration,
+                                 rxPowerW,
+                                 preamble);
   AppendEvent (event);
   return event;
 }
@@ -161,22 +233,94 @@ SpcInterferenceHelper::GetNoiseFigure (void) const
   return m_noiseFigure;
 }
 
+void
+SpcInterferenceHelper::SetCapacityMode (SpcCapacity::Log2Mode mode)
+{
+  m_capacity.SetMode (mode);
+}
+
+void
+SpcInterferenceHelper::SetErrorRateModel (Ptr<SpcErrorRateModel> rate)
+{
+  if (rate == 0)
+    {
+      rate = CreateObject<SpcShannonErrorRateModel> ();
+    }
+  m_errorRateModel = rate;
+}
+
+Ptr<SpcErrorRateModel>
+SpcInterferenceHelper::GetErrorRateModel (void) const
+{
+  return m_errorRateModel;
+}
+
+void
+SpcInterferenceHelper::SetBackgroundTimeConstant (Time tau)
+{
+  m_backgroundTau = tau;
+}
+
+void
+SpcInterferenceHelper::AddBackground (double rxPowerW, Time start, Time duration)
+{
+  Time now = Simulator::Now ();
+  m_backgroundW = GetBackgroundW ();
+  m_backgroundStamp = now;
+  double energyW = rxPowerW * duration.GetSeconds () / m_backgroundTau.GetSeconds ();
+  if (start <= now)
+    {
+      m_backgroundW += energyW;
+    }
+  else
+    {
+      m_backgroundArrivals.insert (std::make_pair (start, energyW));
+    }
+}
+
+double
+SpcInterferenceHelper::GetBackgroundW (void) const
+{
+  Time now = Simulator::Now ();
+  double tau = m_backgroundTau.GetSeconds ();
+  // fold the frames which arrived into the average, each once
+  while (!m_backgroundArrivals.empty () && m_backgroundArrivals.begin ()->first <= now)
+    {
+      std::multimap<Time, double>::iterator i = m_backgroundArrivals.begin ();
+      m_backgroundW = m_backgroundW * std::exp (-(i->first - m_backgroundStamp).GetSeconds () / tau) + i->second;
+      m_backgroundStamp = i->first;
+      m_backgroundArrivals.erase (i);
+    }
+  if (m_backgroundW == 0.0)
+    {
+      return 0.0;
+    }
+  return m_backgroundW * std::exp (-(now - m_backgroundStamp).GetSeconds () / tau);
+}
+
 Time
 SpcInterferenceHelper::GetEnergyDuration (double energyW)
 {
   Time now = Simulator::Now ();
-  double noiseInterferenceW = 0.0;
+  double backgroundW = GetBackgroundW ();
+  // bring the running sum up to the first change not in the past and
+  // scan forward from there instead of summing from the front
+  while (m_cursor != m_niChanges.end () && m_cursor->GetTime () < now)
+    {
+      m_cursorPower += m_cursor->GetDelta ();
+      m_cursor++;
+    }
+  if (m_cursor == m_niChanges.end ())
+    {
+      return MicroSeconds (0);
+    }
   Time end = now;
-  noiseInterferenceW = m_firstPower;
-  for (NiChanges::const_iterator i = m_niChanges.begin (); i != m_niChanges.end (); i++)
+  double power = m_cursorPower;
+  for (NiChanges::const_iterator i = m_cursor; i != m_niChanges.end (); i++)
     {
-      noiseInterferenceW += i->GetDelta ();
       end = i->GetTime ();
-      if (end < now)
-        {
-          continue;
-        }
-      if (noiseInterferenceW < energyW)
+      power += i->GetDelta ();
+      if (power + backgroundW < energyW)
         {
           break;
         }
@@ -188,28 +332,26 @@ void
 SpcInterferenceHelper::AppendEvent (Ptr<SpcInterferenceHelper::Event> event)
 {
   Time now = Simulator::Now ();
-  SpcPreamble pre = event->GetPreamble();
+  const SpcPreamble &pre = event->GetPreamble ();
   if (!m_rxing)
     {
-      NiChanges::iterator nowIterator = GetPosition (now);
-      for (NiChanges::iterator i = m_niChanges.begin (); i != nowIterator; i++)
+      while (m_cursor != m_niChanges.end () && m_cursor->GetTime () <= now)
         {
-          m_firstPower += i->GetDelta ();
+          m_cursorPower += m_cursor->GetDelta ();
+          m_cursor++;
         }
-      m_niChanges.erase (m_niChanges.begin (), nowIterator);
-      m_niChanges.insert (m_niChanges.begin (), NiChange (event->GetStartTime (), event->GetRxPowerW ()));
-    }
-  else
-    {
-      AddNiChangeEvent (NiChange (event->GetStartTime (), event->GetRxPowerW ()));
+      m_niChanges.erase (m_niChanges.begin (), m_cursor);
+      m_firstPower = m_cursorPower;
     }
+  AddNiChangeEvent (NiChange (event->GetStartTime (), event->GetRxPowerW ()));
   AddNiChangeEvent (NiChange (event->GetEndTime (), -event->GetRxPowerW ()));
+  m_highWaterMark = std::max<uint32_t> (m_highWaterMark, m_niChanges.size ());
 
 }
 
 
 double
-SpcInterferenceHelper::CalculateSnr (double signal, double noiseInterference, SpcPreamble preamble) const
+SpcInterferenceHelper::CalculateSnr (double signal, double noiseInterference, const SpcPreamble &preamble) const
 {
   // thermal noise at 290K in J/s = W
   static const double BOLTZMANN = 1.3803e-23;
@@ -217,7 +359,7 @@ SpcInterferenceHelper::CalculateSnr (double signal, double noiseInterference, Sp
   double Nt = BOLTZMANN * 290.0 * preamble.GetBandwidth ();
   // receiver noise Floor (W) which accounts for thermal noise and non-idealities of the receiver
   double noiseFloor = m_noiseFigure * Nt;
-  double noise = noiseFloor + noiseInterference;
+  double noise = noiseFloor + noiseInterference + GetBackgroundW ();
   double snr = signal / noise;
   NS_LOG_DEBUG ("signal=" << signal <<
                 "noise="  << noise  <<
@@ -226,11 +368,14 @@ SpcInterferenceHelper::CalculateSnr (double signal, double noiseInterference, Sp
 }
 
 double
-SpcInterferenceHelper::CalculateNoiseInterferenceW (Ptr<SpcInterferenceHelper::Event> event, NiChanges *ni) const
+SpcInterferenceHelper::CalculateNoiseInterferenceW (Ptr<SpcInterferenceHelper::Event> event, NiSpan *ni) const
 {
   double noiseInterference = m_firstPower;
   NS_ASSERT (m_rxing);
-  for (NiChanges::const_iterator i = m_niChanges.begin () + 1; i != m_niChanges.end (); i++)
+  ni->clear ();
+  ni->push_back (NiChange (event->GetStartTime (), noiseInterference));
+  NiChanges::const_iterator i = m_niChanges.begin ();
+  for (i++; i != m_niChanges.end (); i++)
     {
       if ((event->GetEndTime () == i->GetTime ()) && event->GetRxPowerW () == -i->GetDelta ())
         {
@@ -238,30 +383,39 @@ SpcInterferenceHelper::CalculateNoiseInterferenceW (Ptr<SpcInterferenceHelper::E
         }
       ni->push_back (*i);
     }
-  ni->insert (ni->begin (), NiChange (event->GetStartTime (), noiseInterference));
   ni->push_back (NiChange (event->GetEndTime (), 0));
   return noiseInterference;
 }
 
-bool
-SpcInterferenceHelper::CheckChunkShannonCapacity (double snir, Time duration, SpcPreamble preamble,
+double
+SpcInterferenceHelper::CalculateChunkSuccessRate (double snir, Time duration, const SpcPreamble &preamble,
                                                   uint32_t totalBytes, uint32_t *currentBytes) const
+{
+  return CalculateChunkSuccessRateFromEfficiency (m_capacity.GetEfficiency (snir), duration, preamble, totalBytes, currentBytes);
+}
+
+double
+SpcInterferenceHelper::CalculateChunkSuccessRate (double snir, Time duration, const SpcPreamble &preamble) const
+{
+  return CalculateChunkSuccessRateFromEfficiency (m_capacity.GetEfficiency (snir), duration, preamble);
+}
+
+double
+SpcInterferenceHelper::CalculateChunkSuccessRateFromEfficiency (double efficiency, Time duration, const SpcPreamble &preamble,
+                                                                uint32_t totalBytes, uint32_t *currentBytes) const
 {
   if (duration == NanoSeconds (0))
     {
-      return true;
+      return 1;
     }
 
   uint32_t rate = preamble.GetRate ();
   uint64_t nbytes = (uint64_t)(rate * duration.GetSeconds ());
-  uint64_t shannonBits = preamble.GetBandwidth () * log2 (1 + snir);
-  uint64_t shannonBytes = shannonBits / 8;
-  shannonBytes = shannonBytes * duration.GetSeconds ();
 
   if (*currentBytes == totalBytes)
     {
       NS_LOG_DEBUG ("[mark] equal");
-      return true;
+      return 1;
     }
   else if (totalBytes >= (*currentBytes + nbytes))
     {
@@ -274,52 +428,47 @@ SpcInterferenceHelper::CheckChunkShannonCapacity (double snir, Time duration, Sp
       nbytes = totalBytes - *currentBytes;
       *currentBytes = totalBytes;
     }
-  
-  NS_LOG_DEBUG ("[Slimit]: " << shannonBytes << ", [Bytes]:" << nbytes << ", [SNIR]:" << snir << " , [D]:" << duration);
-    
-  if (shannonBytes >= nbytes)
-    {
-      return true;
-    }
-  else
-    {
-      return false;
-    }
+
+  NS_LOG_DEBUG ("[Bytes]:" << nbytes << ", [log2(1+SNIR)]:" << efficiency << " , [D]:" << duration);
+  return m_errorRateModel->GetChunkSuccessRate (preamble, efficiency, nbytes, duration);
 }
 
-bool
-SpcInterferenceHelper::CheckChunkShannonCapacity (double snir, Time duration, SpcPreamble preamble) const
+double
+SpcInterferenceHelper::CalculateChunkSuccessRateFromEfficiency (double efficiency, Time duration, const SpcPreamble &preamble) const
 {
   if (duration == NanoSeconds (0))
     {
-      return true;
+      return 1;
     }
 
   uint32_t rate = preamble.GetRate ();
   uint64_t nbytes = (uint64_t)(rate * duration.GetSeconds ());
-  uint64_t shannonBits = preamble.GetBandwidth () * log2 (1 + snir);
-  uint64_t shannonBytes = shannonBits / 8;
-  shannonBytes = shannonBytes * duration.GetSeconds ();
 
-  NS_LOG_DEBUG ("[Slimit]: " << shannonBytes << ", [Bytes]:" << nbytes << ", [SNIR]:" << snir << " , [D]:" << duration);
-    
-  if (shannonBytes >= nbytes)
+  NS_LOG_DEBUG ("[Bytes]:" << nbytes << ", [log2(1+SNIR)]:" << efficiency << " , [D]:" << duration);
+  return m_errorRateModel->GetChunkSuccessRate (preamble, efficiency, nbytes, duration);
+}
+
+bool
+SpcInterferenceHelper::GetChunkThreshold (Time duration, const SpcPreamble &preamble, uint64_t totalBytes,
+                                          double *threshold) const
+{
+  if (duration == NanoSeconds (0) || totalBytes == 0)
     {
+      *threshold = 0;
       return true;
     }
-  else
-    {
-      return false;
-    }
+  uint64_t nbytes = std::min<uint64_t> ((uint64_t)(preamble.GetRate () * duration.GetSeconds ()), totalBytes);
+  return m_errorRateModel->GetCapacityThreshold (preamble, nbytes, duration, threshold);
 }
 
 double
-SpcInterferenceHelper::CalculatePer (Ptr<const SpcInterferenceHelper::Event> event, NiChanges *ni) const
+SpcInterferenceHelper::CalculatePer (Ptr<const SpcInterferenceHelper::Event> event, NiSpan *ni) const
 {
   SpcPreamble preambleHdr;
   double snr;
+  double psr = 1.0;
 
-  NiChanges::iterator j = ni->begin ();
+  NiSpan::const_iterator j = ni->begin ();
   Time previous = (*j).GetTime ();
 
   Time preambleStart = (*j).GetTime ();
@@ -327,9 +476,44 @@ SpcInterferenceHelper::CalculatePer (Ptr<const SpcInterferenceHelper::Event> eve
   double noiseInterferenceW = (*j).GetDelta ();
   double powerW = event->GetRxPowerW ();
 
+  if (ni->size () == 2)
+    {
+      // nothing changes during the frame: one SNR for the whole of it
+      m_fastPath++;
+      const SpcPreamble &preamble = event->GetPreamble ();
+      Time end = (*ni)[1].GetTime ();
+      Time headerDuration = Max (Min (payloadStart, end) - previous, Seconds (0));
+      Time payloadDuration = Max (end - Max (payloadStart, previous), Seconds (0));
+      double headerEfficiency = m_capacity.GetEfficiency (CalculateSnr (powerW, noiseInterferenceW, preambleHdr));
+      double payloadEfficiency = headerEfficiency;
+      if (preamble.GetBandwidth () != preambleHdr.GetBandwidth ())
+        {
+          payloadEfficiency = m_capacity.GetEfficiency (CalculateSnr (powerW, noiseInterferenceW, preamble));
+        }
+      double headerThreshold;
+      double payloadThreshold;
+      if (GetChunkThreshold (headerDuration, preambleHdr, std::numeric_limits<uint64_t>::max (), &headerThreshold)
+          && GetChunkThreshold (payloadDuration, preamble, std::numeric_limits<uint64_t>::max (), &payloadThreshold))
+        {
+          if (preamble.GetBandwidth () == preambleHdr.GetBandwidth ())
+            {
+              // header and payload at the same capacity: one comparison
+              return preamble.GetBandwidth () * headerEfficiency >= std::max (headerThreshold, payloadThreshold) ? 0 : 1;
+            }
+          return (preambleHdr.GetBandwidth () * headerEfficiency >= headerThreshold
+                  && preamble.GetBandwidth () * payloadEfficiency >= payloadThreshold) ? 0 : 1;
+        }
+      psr *= CalculateChunkSuccessRateFromEfficiency (headerEfficiency, headerDuration, preambleHdr);
+      if (psr > 0)
+        {
+          psr *= CalculateChunkSuccessRateFromEfficiency (payloadEfficiency, payloadDuration, preamble);
+        }
+      return 1 - psr;
+    }
+
   j++;
 
-  while (ni->end () != j)
+  while (ni->end () != j && psr > 0)
     {
       Time current = (*j).GetTime ();
       if (payloadStart > previous && payloadStart < current)
@@ -337,114 +521,236 @@ SpcInterferenceHelper::CalculatePer (Ptr<const SpcInterferenceHelper::Event> eve
           
           // Header
           snr = CalculateSnr (powerW, noiseInterferenceW, preambleHdr);
-          if (!CheckChunkShannonCapacity (snr, payloadStart - previous, preambleHdr))
-            {
-              return 1;
-            }
+          psr *= CalculateChunkSuccessRate (snr, payloadStart - previous, preambleHdr);
                                         
           // Payload
           snr = CalculateSnr (powerW, noiseInterferenceW, event->GetPreamble ());
-          if (!CheckChunkShannonCapacity (snr, current - payloadStart, event->GetPreamble ()))
-            {
-              return 1;
-            }
+          psr *= CalculateChunkSuccessRate (snr, current - payloadStart, event->GetPreamble ());
         }
       else if (payloadStart >= current)
         {
           // Header
           snr = CalculateSnr (powerW, noiseInterferenceW, preambleHdr);
-          if (!CheckChunkShannonCapacity (snr , current - previous, preambleHdr))
-            {
-              return 1;
-            }
+          psr *= CalculateChunkSuccessRate (snr , current - previous, preambleHdr);
         }
       else if (payloadStart < current)
         {
           // Payload
           snr = CalculateSnr (powerW, noiseInterferenceW, event->GetPreamble ());
-          if (!CheckChunkShannonCapacity (snr, current - previous, event->GetPreamble ()))
-            {
-              return 1;
-            }
+          psr *= CalculateChunkSuccessRate (snr, current - previous, event->GetPreamble ());
         }
       noiseInterferenceW += (*j).GetDelta ();
       previous = (*j).GetTime ();
       j++;
     }
 
-  return 0;
+  return 1 - psr;
 }
 
-double
-SpcInterferenceHelper::CalculatePer (Ptr<const SpcInterferenceHelper::Event> event, NiChanges *ni, double power, double noise, uint32_t totalBytes) const
+void
+SpcInterferenceHelper::CalculatePer2 (Ptr<const SpcInterferenceHelper::Event> event, NiSpan *ni,
+                                      double outerPower, double outerNoise, uint32_t outerBytes,
+                                      double innerPower, uint32_t innerBytes,
+                                      double *outerPer, double *innerPer) const
 {
   SpcPreamble preambleHdr;
+  const SpcPreamble &preamble = event->GetPreamble ();
   double snr;
 
-  NiChanges::iterator j = ni->begin ();
+  NiSpan::const_iterator j = ni->begin ();
   Time previous = (*j).GetTime ();
 
-  Time preambleStart = (*j).GetTime ();
-  Time payloadStart  = (*j).GetTime () + event->GetPreamble ().GetDuration ();
+  Time payloadStart  = (*j).GetTime () + preamble.GetDuration ();
+  // the header is checked against the interference at the frame start
   double normalNoiseInterferenceW = (*j).GetDelta ();
-  double noiseInterferenceW = (*j).GetDelta () + noise;
+  double noiseInterferenceW = (*j).GetDelta ();
   double allPowerW = event->GetRxPowerW ();
-  double powerW = event->GetRxPowerW () * power;
+  double outerPowerW = allPowerW * outerPower;
+  double innerPowerW = allPowerW * innerPower;
+
+  uint32_t outerCurrentBytes = 0;
+  uint32_t innerCurrentBytes = 0;
+  // success rate of the header and the outer layer, and of the inner
+  // layer alone; the inner layer needs the outer one decoded first
+  double outerPsr = 1.0;
+  double innerPsr = 1.0;
+
+  if (ni->size () == 2)
+    {
+      // nothing changes during the frame: one SNR per layer
+      m_fastPath++;
+      Time end = (*ni)[1].GetTime ();
+      Time headerDuration = Max (Min (payloadStart, end) - previous, Seconds (0));
+      Time payloadDuration = Max (end - Max (payloadStart, previous), Seconds (0));
+      double headerEfficiency = m_capacity.GetEfficiency (CalculateSnr (allPowerW, normalNoiseInterferenceW, preambleHdr));
+      double outerEfficiency = m_capacity.GetEfficiency (CalculateSnr (outerPowerW, noiseInterferenceW + outerNoise, preamble));
+      double innerEfficiency = m_capacity.GetEfficiency (CalculateSnr (innerPowerW, noiseInterferenceW, preamble));
+      double headerThreshold;
+      double outerThreshold;
+      double innerThreshold;
+      if (GetChunkThreshold (headerDuration, preambleHdr, std::numeric_limits<uint64_t>::max (), &headerThreshold)
+          && GetChunkThreshold (payloadDuration, preamble, outerBytes, &outerThreshold)
+          && GetChunkThreshold (payloadDuration, preamble, innerBytes, &innerThreshold))
+        {
+          bool outer = preambleHdr.GetBandwidth () * headerEfficiency >= headerThreshold
+            && preamble.GetBandwidth () * outerEfficiency >= outerThreshold;
+          bool inner = outer && preamble.GetBandwidth () * innerEfficiency >= innerThreshold;
+          *outerPer = outer ? 0 : 1;
+          *innerPer = inner ? 0 : 1;
+          return;
+        }
+      outerPsr *= CalculateChunkSuccessRateFromEfficiency (headerEfficiency, headerDuration, preambleHdr);
+      if (outerPsr > 0)
+        {
+          outerPsr *= CalculateChunkSuccessRateFromEfficiency (outerEfficiency, payloadDuration, preamble,
+                                                              outerBytes, &outerCurrentBytes);
+        }
+      if (outerPsr > 0)
+        {
+          innerPsr *= CalculateChunkSuccessRateFromEfficiency (innerEfficiency, payloadDuration, preamble,
+                                                              innerBytes, &innerCurrentBytes);
+        }
+      *outerPer = 1 - outerPsr;
+      *innerPer = 1 - outerPsr * innerPsr;
+      return;
+    }
 
   j++;
-  uint32_t currentBytes = 0;
-  NS_LOG_DEBUG ("total Bytes=" << totalBytes);
-  while (ni->end () != j)
+  NS_LOG_DEBUG ("total Bytes=" << outerBytes << "/" << innerBytes);
+  while (ni->end () != j && outerPsr > 0)
     {
       Time current = (*j).GetTime ();
-      if (payloadStart > previous && payloadStart < current)
+      Time payloadFrom = previous;
+      if (payloadStart > previous)
         {
-          // Header
+          // Header, common to both layers
           snr = CalculateSnr (allPowerW, normalNoiseInterferenceW, preambleHdr);
-          if (!CheckChunkShannonCapacity (snr, payloadStart - previous, preambleHdr))
-            {
-              return 1;
-            }
-                                        
+          outerPsr *= CalculateChunkSuccessRate (snr, Min (payloadStart, current) - previous, preambleHdr);
+          payloadFrom = payloadStart;
+        }
+      if (payloadStart < current && outerPsr > 0)
+        {
           // Payload
-          snr = CalculateSnr (powerW, noiseInterferenceW, event->GetPreamble ());
-          if (!CheckChunkShannonCapacity (snr, current - payloadStart, event->GetPreamble (), totalBytes ,&currentBytes))
+          snr = CalculateSnr (outerPowerW, noiseInterferenceW + outerNoise, preamble);
+          outerPsr *= CalculateChunkSuccessRate (snr, current - payloadFrom, preamble, outerBytes, &outerCurrentBytes);
+          if (innerPsr > 0)
             {
-              return 1;
+              snr = CalculateSnr (innerPowerW, noiseInterferenceW, preamble);
+              innerPsr *= CalculateChunkSuccessRate (snr, current - payloadFrom, preamble, innerBytes, &innerCurrentBytes);
             }
         }
-      else if (payloadStart >= current)
+      noiseInterferenceW += (*j).GetDelta ();
+      previous = (*j).GetTime ();
+      j++;
+    }
+
+  *outerPer = 1 - outerPsr;
+  *innerPer = 1 - outerPsr * innerPsr;
+}
+
+double
+SpcInterferenceHelper::CalculateRangePsr (Ptr<const SpcInterferenceHelper::Event> event, const NiSpan &ni,
+                                          double signalW, double otherW, uint32_t offset, uint32_t totalBytes,
+                                          const SpcSubframeBounds &bounds, bool header,
+                                          double *subframePsr) const
+{
+  SpcPreamble preambleHdr;
+  const SpcPreamble &preamble = event->GetPreamble ();
+  uint32_t rate = preamble.GetRate ();
+  double psr = 1.0;
+  uint32_t nBounds = bounds.GetN ();
+  std::fill (subframePsr, subframePsr + (nBounds == 0 ? 0 : nBounds - 1), 1.0);
+
+  NiSpan::const_iterator j = ni.begin ();
+  Time previous = (*j).GetTime ();
+  Time payloadStart = previous + preamble.GetDuration ();
+  double noiseInterferenceW = (*j).GetDelta ();
+  uint32_t currentBytes = 0;
+  // number of bounds at or before currentBytes
+  uint32_t next = 0;
+
+  for (j++; j != ni.end (); j++)
+    {
+      Time current = (*j).GetTime ();
+      Time payloadFrom = previous;
+      if (payloadStart > previous)
         {
-          // Header
-          snr = CalculateSnr (allPowerW, normalNoiseInterferenceW, preambleHdr);
-          if (!CheckChunkShannonCapacity (snr , current - previous, preambleHdr))
+          if (header)
             {
-              return 1;
+              double snr = CalculateSnr (event->GetRxPowerW (), noiseInterferenceW, preambleHdr);
+              psr *= CalculateChunkSuccessRate (snr, Min (payloadStart, current) - previous, preambleHdr);
             }
+          payloadFrom = payloadStart;
         }
-      else if (payloadStart < current)
+      if (payloadStart < current && currentBytes < totalBytes)
         {
-          // Payload
-          snr = CalculateSnr (powerW, noiseInterferenceW, event->GetPreamble ());
-          if (!CheckChunkShannonCapacity (snr, current - previous, event->GetPreamble (), totalBytes ,&currentBytes))
+          double efficiency = m_capacity.GetEfficiency (CalculateSnr (signalW, noiseInterferenceW + otherW, preamble));
+          uint64_t nbytes = (uint64_t)(rate * (current - payloadFrom).GetSeconds ());
+          uint32_t chunkEnd = std::min<uint64_t> (totalBytes, currentBytes + nbytes);
+          // split the chunk where a subframe starts or ends
+          while (currentBytes < chunkEnd)
             {
-              return 1;
+              while (next < nBounds && offset + bounds.Get (next) <= currentBytes)
+                {
+                  next++;
+                }
+              uint32_t pieceEnd = chunkEnd;
+              if (next < nBounds)
+                {
+                  pieceEnd = std::min (pieceEnd, offset + bounds.Get (next));
+                }
+              uint32_t pieceBytes = pieceEnd - currentBytes;
+              double piecePsr = m_errorRateModel->GetChunkSuccessRate (preamble, efficiency, pieceBytes,
+                                                                       Seconds ((double)pieceBytes / rate));
+              if (next > 0 && next < nBounds)
+                {
+                  subframePsr[next - 1] *= piecePsr;
+                }
+              else
+                {
+                  psr *= piecePsr;
+                }
+              currentBytes = pieceEnd;
             }
         }
       noiseInterferenceW += (*j).GetDelta ();
-      previous = (*j).GetTime ();
-      j++;
+      previous = current;
     }
-
-  return 0;
+  return psr;
 }
 
+double
+SpcInterferenceHelper::CalculateLayerPsr (Ptr<const SpcInterferenceHelper::Event> event, bool first,
+                                          double *subframePsr) const
+{
+  const SpcPreamble &preamble = event->GetPreamble ();
+  double firstW = event->GetRxPowerW () * preamble.GetPower ();
+  double secondW = event->GetRxPowerW () - firstW;
+  double signalW = first ? firstW : secondW;
+  double otherW = first ? secondW : firstW;
+  uint32_t bytes = first ? preamble.GetNLength () : preamble.GetFLength ();
+  uint32_t otherBytes = first ? preamble.GetFLength () : preamble.GetNLength ();
+  const SpcSubframeBounds &bounds = first ? preamble.GetNSubframes () : preamble.GetFSubframes ();
+
+  // the far layer is the outer one, see CalculateSnrPer2
+  if (first == preamble.GetIsFar ())
+    {
+      return CalculateRangePsr (event, m_ni, signalW, otherW, 0, bytes, bounds, true, subframePsr);
+    }
+  double psr = CalculateRangePsr (event, m_ni, signalW, 0, 0, bytes, bounds, true, subframePsr);
+  double cancelPsr[SPC_MAC_MAX_SUBFRAMES];
+  psr *= CalculateRangePsr (event, m_ni, otherW, signalW, 0, std::min (bytes, otherBytes), bounds, false, cancelPsr);
+  for (uint32_t i = 0; i + 1 < bounds.GetN (); i++)
+    {
+      subframePsr[i] *= cancelPsr[i];
+    }
+  return psr;
+}
 
 struct SpcInterferenceHelper::SnrPer
 SpcInterferenceHelper::CalculateSnrPer (Ptr<SpcInterferenceHelper::Event> event)
 {
-  NiChanges ni;
-  double noiseInterferenceW = CalculateNoiseInterferenceW (event, &ni);
+  double noiseInterferenceW = CalculateNoiseInterferenceW (event, &m_ni);
 
   double snr = CalculateSnr (event->GetRxPowerW (),
                              noiseInterferenceW,
@@ -453,21 +759,30 @@ SpcInterferenceHelper::CalculateSnrPer (Ptr<SpcInterferenceHelper::Event> event)
   /* calculate the SNIR at the start of the packet and accumulate
    * all SNIR changes in the snir vector.
    */
-  double per = CalculatePer (event, &ni);
+  double per = CalculatePer (event, &m_ni);
 
   struct SnrPer snrPer;
   snrPer.snr = snr;
   snrPer.per = per;
+  snrPer.nSubframes = 0;
+  const SpcPreamble &preamble = event->GetPreamble ();
+  if (!preamble.GetNSubframes ().IsEmpty ())
+    {
+      // the MAC header comes before the body
+      uint32_t offset = event->GetSize () - preamble.GetNLength ();
+      snrPer.per = 1 - CalculateRangePsr (event, m_ni, event->GetRxPowerW (), 0, offset, event->GetSize (),
+                                          preamble.GetNSubframes (), true, snrPer.subframePsr);
+      snrPer.nSubframes = preamble.GetNSubframes ().GetN () - 1;
+    }
   return snrPer;
 }
 
 struct SpcInterferenceHelper::SnrPer2
 SpcInterferenceHelper::CalculateSnrPer2 (Ptr<SpcInterferenceHelper::Event> event)
 {
-  NiChanges ni;
-  double noiseInterferenceW = CalculateNoiseInterferenceW (event, &ni);
+  double noiseInterferenceW = CalculateNoiseInterferenceW (event, &m_ni);
 
-  SpcPreamble preamble = event->GetPreamble ();
+  const SpcPreamble &preamble = event->GetPreamble ();
   double powRate1 = preamble.GetPower ();
   double powRate2 = 1 - powRate1;
   double noise;
@@ -484,15 +799,10 @@ SpcInterferenceHelper::CalculateSnrPer2 (Ptr<SpcInterferenceHelper::Event> event
                            noiseInterferenceW,
                            event->GetPreamble ());
 
-      per1 = CalculatePer (event, &ni, powRate1, noise, event->GetPreamble ().GetNLength ());
-      if (per1 == 1)
-        {
-          per2 = 1;
-        }
-      else
-        {
-          per2 = CalculatePer (event, &ni, powRate2, 0, event->GetPreamble ().GetFLength ());
-        }
+      CalculatePer2 (event, &m_ni,
+                     powRate1, noise, preamble.GetNLength (),
+                     powRate2, preamble.GetFLength (),
+                     &per1, &per2);
     }
   else
     {
@@ -503,15 +813,10 @@ SpcInterferenceHelper::CalculateSnrPer2 (Ptr<SpcInterferenceHelper::Event> event
       snr2 = CalculateSnr (event->GetRxPowerW () * powRate2,
                            noiseInterferenceW + noise,
                            event->GetPreamble ());
-      per2 = CalculatePer (event, &ni, powRate2, noise, event->GetPreamble ().GetFLength ());
-      if (per2 == 1)
-        {
-          per1 = 1;
-        }
-      else
-        {
-          per1 = CalculatePer (event, &ni, powRate1, 0, event->GetPreamble ().GetNLength ());
-        }
+      CalculatePer2 (event, &m_ni,
+                     powRate2, noise, preamble.GetFLength (),
+                     powRate1, preamble.GetNLength (),
+                     &per2, &per1);
     }
 
 
@@ -526,6 +831,18 @@ SpcInterferenceHelper::CalculateSnrPer2 (Ptr<SpcInterferenceHelper::Event> event
   snrPer2.snr2 = snr2;
   snrPer2.per1 = per1;
   snrPer2.per2 = per2;
+  snrPer2.nSubframes1 = 0;
+  snrPer2.nSubframes2 = 0;
+  if (!preamble.GetNSubframes ().IsEmpty ())
+    {
+      snrPer2.per1 = 1 - CalculateLayerPsr (event, true, snrPer2.subframePsr1);
+      snrPer2.nSubframes1 = preamble.GetNSubframes ().GetN () - 1;
+    }
+  if (!preamble.GetFSubframes ().IsEmpty ())
+    {
+      snrPer2.per2 = 1 - CalculateLayerPsr (event, false, snrPer2.subframePsr2);
+      snrPer2.nSubframes2 = preamble.GetFSubframes ().GetN () - 1;
+    }
   return snrPer2;
 }
 
@@ -535,17 +852,41 @@ SpcInterferenceHelper::EraseEvents (void)
   m_niChanges.clear ();
   m_rxing = false;
   m_firstPower = 0.0;
-}
-SpcInterferenceHelper::NiChanges::iterator
-SpcInterferenceHelper::GetPosition (Time moment)
-{
-  return std::upper_bound (m_niChanges.begin (), m_niChanges.end (), NiChange (moment, 0));
+  m_cursor = m_niChanges.end ();
+  m_cursorPower = 0.0;
+  m_backgroundW = 0.0;
+  m_backgroundArrivals.clear ();
 }
 void
 SpcInterferenceHelper::AddNiChangeEvent (NiChange change)
 {
-  m_niChanges.insert (GetPosition (change.GetTime ()), change);
+  // after the changes at the same time, so never before the cursor
+  NiChanges::iterator i = m_niChanges.insert (change);
+  NiChanges::iterator next = i;
+  if (++next == m_cursor)
+    {
+      m_cursor = i;
+    }
+}
+
+uint64_t
+SpcInterferenceHelper::GetFastPathCount (void) const
+{
+  return m_fastPath;
+}
+
+uint64_t
+SpcInterferenceHelper::GetEventAllocations (void) const
+{
+  return m_eventPool->GetAllocations ();
+}
+
+uint32_t
+SpcInterferenceHelper::GetNiChangesHighWaterMark (void) const
+{
+  return m_highWaterMark;
 }
+
 void
 SpcInterferenceHelper::NotifyRxStart ()
 {
@@ -43,9 +43,14 @@
 #include <stdint.h>
 #include <vector>
 #include <list>
+#include <set>
+#include <map>
 #include "ns3/nstime.h"
 #include "ns3/simple-ref-count.h"
+#include "ns3/ptr.h"
 #include "spc-preamble.h"
+#include "spc-capacity.h"
+#include "spc-error-rate-model.h"
 
 namespace ns3 {
 
@@ -56,14 +61,22 @@ namespace ns3 {
 class SpcInterferenceHelper
 {
 public:
+  class Event;
+  class EventPool;
+  /// Hands an Event whose last reference is dropped back to its pool
+  struct EventDeleter
+  {
+    static void Delete (Event *event);
+  };
+
   /**
    * Signal event for a packet.
    */
-  class Event : public SimpleRefCount<SpcInterferenceHelper::Event>
+  class Event : public SimpleRefCount<SpcInterferenceHelper::Event, empty, SpcInterferenceHelper::EventDeleter>
   {
 public:
 
-    Event (uint32_t size, Time duration, double rxPower, SpcPreamble preamble);
+    Event (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble);
     ~Event ();
 
     Time GetDuration (void) const;
@@ -71,20 +84,56 @@ public:
     Time GetEndTime (void) const;
     double GetRxPowerW (void) const;
     uint32_t GetSize (void) const;
-    SpcPreamble GetPreamble (void) const;
+    const SpcPreamble &GetPreamble (void) const;
 
 private:
+    friend class SpcInterferenceHelper::EventPool;
+    friend struct SpcInterferenceHelper::EventDeleter;
+
+    void Init (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble);
+
     uint32_t m_size;
     Time m_startTime;
     Time m_endTime;
     double m_rxPowerW;
     SpcPreamble m_preamble;
+    /// Pool the event goes back to, null for an event made with Create
+    Ptr<EventPool> m_pool;
+  };
+
+  /**
+   * Free list of Events.  An event is reused once every reference to it
+   * is dropped, so after warm-up a reception allocates nothing.  The
+   * pool is reference counted by its events and outlives the helper
+   * while an event is still held, e.g. by a pending EndReceive.
+   */
+  class EventPool : public SimpleRefCount<SpcInterferenceHelper::EventPool>
+  {
+public:
+    EventPool ();
+    ~EventPool ();
+
+    Ptr<Event> Allocate (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble);
+    void Release (Event *event);
+    /// Number of events created with new
+    uint64_t GetAllocations (void) const;
+
+private:
+    std::vector<Event *> m_free;
+    uint64_t m_allocations;
   };
 
+  /**
+   * For an aggregate frame per leaves out the subframes, each of which
+   * is received with its own success rate in subframePsr, the first
+   * nSubframes of which are set.
+   */
   struct SnrPer
   {
     double snr;
     double per;
+    uint32_t nSubframes;
+    double subframePsr[SPC_MAC_MAX_SUBFRAMES];
   };
 
   struct SnrPer2
@@ -93,6 +142,10 @@ private:
     double snr2;
     double per1;
     double per2;
+    uint32_t nSubframes1;
+    uint32_t nSubframes2;
+    double subframePsr1[SPC_MAC_MAX_SUBFRAMES];
+    double subframePsr2[SPC_MAC_MAX_SUBFRAMES];
   };
 
   SpcInterferenceHelper ();
@@ -100,10 +153,26 @@ private:
 
   void SetNoiseFigure (double value);
   double GetNoiseFigure (void) const;
+  void SetCapacityMode (SpcCapacity::Log2Mode mode);
+  /// A null model selects SpcShannonErrorRateModel
+  void SetErrorRateModel (Ptr<SpcErrorRateModel> rate);
+  Ptr<SpcErrorRateModel> GetErrorRateModel (void) const;
 
   Time GetEnergyDuration (double energyW);
 
-  Ptr<SpcInterferenceHelper::Event> Add (uint32_t size, Time duration, double rxPower, SpcPreamble preamble);
+  /**
+   * Mean-field interference: the energy of frames too weak to matter
+   * individually is spread over an exponentially weighted average
+   * with time constant tau instead of creating NiChanges. The energy
+   * of a frame counts from its arrival at \p start, which may be later
+   * than now by the propagation delay.
+   */
+  void SetBackgroundTimeConstant (Time tau);
+  void AddBackground (double rxPowerW, Time start, Time duration);
+  /// Average background power (W) at the current time; each arrival is folded in once
+  double GetBackgroundW (void) const;
+
+  Ptr<SpcInterferenceHelper::Event> Add (uint32_t size, Time duration, double rxPower, const SpcPreamble &preamble);
 
   struct SpcInterferenceHelper::SnrPer CalculateSnrPer (Ptr<SpcInterferenceHelper::Event> event);
   struct SpcInterferenceHelper::SnrPer2 CalculateSnrPer2 (Ptr<SpcInterferenceHelper::Event> event);
@@ -111,6 +180,12 @@ private:
   void NotifyRxStart ();
   void NotifyRxEnd ();
   void EraseEvents (void);
+  /// Largest number of NiChanges held at any time
+  uint32_t GetNiChangesHighWaterMark (void) const;
+  /// Number of PER evaluations of frames which saw no NiChange
+  uint64_t GetFastPathCount (void) const;
+  /// Number of Events allocated on the heap rather than taken from the pool
+  uint64_t GetEventAllocations (void) const;
 
 private:
 
@@ -129,27 +204,98 @@ private:
     double m_delta;
   };
 
-  typedef std::vector <NiChange> NiChanges;
+  /**
+   * Sorted by time, changes at the same time in insertion order.  A
+   * balanced tree: a change is inserted in O(log n) and each expired
+   * change is erased from the front in O(1).
+   */
+  typedef std::multiset <NiChange> NiChanges;
   typedef std::list<Ptr<Event> > Events;
 
   void AppendEvent (Ptr<Event> event);
 
-  double CalculateNoiseInterferenceW (Ptr<Event> event, NiChanges *ni) const;
-  double CalculateSnr (double signal, double noiseInterference, SpcPreamble preamble) const;
-  bool CheckChunkShannonCapacity (double snir, Time duration, SpcPreamble preamble) const;
-  bool CheckChunkShannonCapacity (double snir, Time duration, SpcPreamble preamble, uint32_t totalBytes, uint32_t *currentBytes) const;
-  double CalculatePer (Ptr<const Event> event, NiChanges *ni) const;
-  double CalculatePer (Ptr<const Event> event, NiChanges *ni, double power, double noise, uint32_t totalBytes) const;
+  /**
+   * Changes seen by one frame: its start with the power present then,
+   * the changes during the frame and its end.  Built in a scratch
+   * buffer which keeps its capacity between frames.
+   */
+  typedef std::vector <NiChange> NiSpan;
+
+  double CalculateNoiseInterferenceW (Ptr<Event> event, NiSpan *ni) const;
+  double CalculateSnr (double signal, double noiseInterference, const SpcPreamble &preamble) const;
+  /// Probability that a chunk at the given SNR is received, from the error rate model
+  double CalculateChunkSuccessRate (double snir, Time duration, const SpcPreamble &preamble) const;
+  double CalculateChunkSuccessRate (double snir, Time duration, const SpcPreamble &preamble, uint32_t totalBytes, uint32_t *currentBytes) const;
+  /// As CalculateChunkSuccessRate, with log2 (1 + snir) already computed
+  double CalculateChunkSuccessRateFromEfficiency (double efficiency, Time duration, const SpcPreamble &preamble) const;
+  double CalculateChunkSuccessRateFromEfficiency (double efficiency, Time duration, const SpcPreamble &preamble, uint32_t totalBytes, uint32_t *currentBytes) const;
+  /**
+   * Capacity threshold (SpcErrorRateModel::GetCapacityThreshold) of a
+   * chunk at the start of a layer of totalBytes; an empty chunk is
+   * always received.  False if the error rate model has none.
+   */
+  bool GetChunkThreshold (Time duration, const SpcPreamble &preamble, uint64_t totalBytes, double *threshold) const;
+  double CalculatePer (Ptr<const Event> event, NiSpan *ni) const;
+  /**
+   * PER of both layers of a superposed frame in one walk over ni.  The
+   * outer layer is decoded first and sees the inner layer as noise;
+   * when it fails the inner layer fails too, so innerPer >= outerPer.
+   */
+  void CalculatePer2 (Ptr<const Event> event, NiSpan *ni,
+                      double outerPower, double outerNoise, uint32_t outerBytes,
+                      double innerPower, uint32_t innerBytes,
+                      double *outerPer, double *innerPer) const;
+  /**
+   * Success rate of byte ranges of a layer of event, sent at the
+   * preamble rate from the start of the payload, offset bytes before
+   * the frame body and totalBytes long.  Subframe i is decoded alone
+   * from the bytes between bounds i and i + 1 of the body, into
+   * subframePsr[i]; the rest of the layer, with the header when
+   * header is set, gives the returned success rate.  signalW is the
+   * power of the layer and otherW that of the layer it sees as noise.
+   */
+  double CalculateRangePsr (Ptr<const Event> event, const NiSpan &ni, double signalW, double otherW,
+                            uint32_t offset, uint32_t totalBytes, const SpcSubframeBounds &bounds,
+                            bool header, double *subframePsr) const;
+  /**
+   * CalculateRangePsr of layer 1 (first) or 2 of an aggregate superposed
+   * frame.  The inner layer, decoded second, also needs the same bytes
+   * of the outer layer decoded to cancel them.
+   */
+  double CalculateLayerPsr (Ptr<const Event> event, bool first, double *subframePsr) const;
 
   double m_noiseFigure; /**< noise figure (linear) */
-  /// Experimental: needed for energy duration calculation
+  SpcCapacity m_capacity;
+  Ptr<SpcErrorRateModel> m_errorRateModel;
+  Ptr<EventPool> m_eventPool;
+  /**
+   * Experimental: needed for energy duration calculation.  Changes before
+   * now are expired at each new frame unless one is being received, so
+   * the store is bounded by the changes of the frames which overlap the
+   * frame being received, all needed by its SNR walk.
+   */
   NiChanges m_niChanges;
+  NiSpan m_ni;
   double m_firstPower;
+  /**
+   * Running power sum: m_cursorPower is m_firstPower plus the deltas of
+   * the changes before m_cursor.  Every change before the cursor is at
+   * or before now, so a new change never lands before it and the cursor
+   * only moves forward, over each change once.
+   */
+  NiChanges::iterator m_cursor;
+  double m_cursorPower;
   bool m_rxing;
-  /// Returns an iterator to the first nichange, which is later than moment
-  NiChanges::iterator GetPosition (Time moment);
+  uint32_t m_highWaterMark;
+  mutable uint64_t m_fastPath;
+  /// average at m_backgroundStamp, with the arrivals up to then folded in
+  mutable double m_backgroundW;
+  mutable Time m_backgroundStamp;
+  Time m_backgroundTau;
+  /// energy (W over tau) of background frames still propagating, by arrival time
+  mutable std::multimap<Time, double> m_backgroundArrivals;
   /**
-   * Add NiChange to the list at the appropriate position.
+   * Add NiChange to the list at the appropriate position, in O(log n).
    *
    * \param change
    */
@@ -38,6 +38,9 @@ enum
 };
 
 SpcMacHeader::SpcMacHeader ()
+  : m_spcNum (0),
+    m_aggregate (false),
+    m_seqSeq (0)
 {
 }
 SpcMacHeader::~SpcMacHeader ()
@@ -111,6 +114,18 @@ SpcMacHeader::SetRtsRssi (uint8_t rssi)
   m_rtsRssi = rssi;
 }
 
+void
+SpcMacHeader::SetAggregate (bool aggregate)
+{
+  m_aggregate = aggregate;
+}
+
+void
+SpcMacHeader::SetBlockAck (uint16_t bitmap)
+{
+  m_seqSeq = bitmap;
+}
+
 Mac48Address
 SpcMacHeader::GetAddr1 (void) const
 {
@@ -179,6 +194,18 @@ SpcMacHeader::GetRtsRssi (void) const
   return m_rtsRssi;
 }
 
+bool
+SpcMacHeader::IsAggregate (void) const
+{
+  return m_aggregate;
+}
+
+uint16_t
+SpcMacHeader::GetBlockAck (void) const
+{
+  return m_seqSeq;
+}
+
 uint32_t
 SpcMacHeader::GetSize (void) const
 {
@@ -204,7 +231,7 @@ SpcMacHeader::GetSize (void) const
       size = 2 + 2 + 1 + 6;
       break;
     case TYPE_ACK:
-      size = 2 + 2 + 6;
+      size = 2 + 2 + 6 + 2;
       break;
     }
   return size;
@@ -252,9 +279,13 @@ SpcMacHeader::Print (std::ostream &os) const
       os <<  ", DA=" << m_addr1 << ", RSSI=" << m_rtsRssi;
       break;
     case TYPE_ACK:
-      os << ", DA=" << m_addr1;
+      os << ", DA=" << m_addr1 << ", bitmap=" << m_seqSeq;
       break;
     }
+  if (m_aggregate)
+    {
+      os << ", aggregate";
+    }
 }
 uint16_t
 SpcMacHeader::GetFrameControl (void) const
@@ -262,6 +293,7 @@ SpcMacHeader::GetFrameControl (void) const
   uint16_t val = 0;
   val |= m_ctrlType & 0x7;
   val |= (m_spcNum << 3) & (0x1 << 3);
+  val |= (m_aggregate << 4) & (0x1 << 4);
   return val;
 }
 void
@@ -269,6 +301,7 @@ SpcMacHeader::SetFrameControl (uint16_t ctrl)
 {
   m_ctrlType = ctrl & 0x07;
   m_spcNum   = (ctrl >> 3) & 0x01;
+  m_aggregate = (ctrl >> 4) & 0x01;
 }
 uint32_t
 SpcMacHeader::GetSerializedSize (void) const
@@ -303,7 +336,7 @@ SpcMacHeader::Serialize (Buffer::Iterator i) const
       i.WriteU8 (m_rtsRssi);
       break;
     case TYPE_ACK:
-      // do nothing
+      i.WriteHtolsbU16 (m_seqSeq);
       break;
     }
 }
@@ -338,7 +371,7 @@ SpcMacHeader::Deserialize (Buffer::Iterator start)
       m_rtsRssi = i.ReadU8 ();
       break;
     case TYPE_ACK:
-      // do nothing
+      m_seqSeq = i.ReadLsbtohU16 ();
       break;
     }
   return i.GetDistanceFrom (start);
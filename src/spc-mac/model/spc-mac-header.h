@@ -30,6 +30,9 @@
 
 namespace ns3 {
 
+/// Subframes of an aggregate, one per bit of the block-ack bitmap
+static const uint32_t SPC_MAC_MAX_SUBFRAMES = 16;
+
 /**
  * Combination of valid MAC header type/subtype.
  */
@@ -87,6 +90,10 @@ public:
   void SetSpcNum (uint8_t spcNum);
   void SetDuration (Time duration);
   void SetRtsRssi (uint8_t rssi);
+  /// The body is a sequence of SpcAmsduSubframeHeader and packet pairs
+  void SetAggregate (bool aggregate);
+  /// Of an ACK: bit i is set when subframe i of the data frame was received
+  void SetBlockAck (uint16_t bitmap);
 
   Mac48Address GetAddr1 (void) const;
   Mac48Address GetAddr2 (void) const;
@@ -97,6 +104,8 @@ public:
   uint16_t GetFrameControl (void) const;
   uint32_t GetSize (void) const;
   uint8_t GetRtsRssi (void) const;
+  bool IsAggregate (void) const;
+  uint16_t GetBlockAck (void) const;
   const char * GetTypeString (void) const;
 
 private:
@@ -106,6 +115,7 @@ private:
 
   uint8_t m_ctrlType;
   uint8_t m_spcNum;
+  bool m_aggregate;
   uint16_t m_duration;
   Mac48Address m_addr1;
   Mac48Address m_addr2;
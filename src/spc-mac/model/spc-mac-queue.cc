@@ -43,6 +43,11 @@
 #include "ns3/simulator.h"
 #include "ns3/packet.h"
 #include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/assert.h"
+#include "ns3/trace-source-accessor.h"
+#include <algorithm>
+#include <cmath>
 
 #include "spc-mac.h"
 #include "spc-mac-queue.h"
@@ -53,10 +58,14 @@ NS_OBJECT_ENSURE_REGISTERED (SpcMacQueue);
 
 SpcMacQueue::Item::Item (Ptr<const Packet> packet,
                           const SpcMacHeader &hdr,
-                          Time tstamp)
+                          Time tstamp,
+                          const PacketInfo &info,
+                          bool requeued)
   : packet (packet),
     hdr (hdr),
-    tstamp (tstamp)
+    tstamp (tstamp),
+    info (info),
+    requeued (requeued)
 {
 }
 
@@ -70,12 +79,41 @@ SpcMacQueue::GetTypeId (void)
                    UintegerValue (400),
                    MakeUintegerAccessor (&SpcMacQueue::m_maxSize),
                    MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("MaxDelay", "If a packet stays longer than this delay in the queue, it is dropped; 0 to keep every packet.",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&SpcMacQueue::m_maxDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("ControlledDelay", "Drop packets at dequeue by CoDel, from their sojourn time in the queue.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&SpcMacQueue::m_controlledDelay),
+                   MakeBooleanChecker ())
+    .AddAttribute ("Target", "CoDel: acceptable standing sojourn time.",
+                   TimeValue (MilliSeconds (5)),
+                   MakeTimeAccessor (&SpcMacQueue::m_target),
+                   MakeTimeChecker ())
+    .AddAttribute ("Interval", "CoDel: how long the sojourn time may stay above Target before packets are dropped.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&SpcMacQueue::m_interval),
+                   MakeTimeChecker ())
+    .AddTraceSource ("Drop", "A packet has been dropped by the queue",
+                     MakeTraceSourceAccessor (&SpcMacQueue::m_dropTrace))
+    .AddTraceSource ("Sojourn", "Time spent in the queue by a packet leaving it to be sent",
+                     MakeTraceSourceAccessor (&SpcMacQueue::m_sojournTrace))
   ;
   return tid;
 }
 
 SpcMacQueue::SpcMacQueue ()
-  : m_size (0)
+  : m_size (0),
+    m_maxDelay (Seconds (0)),
+    m_controlledDelay (false),
+    m_target (MilliSeconds (5)),
+    m_interval (MilliSeconds (100)),
+    m_dropping (false),
+    m_firstAboveTime (Seconds (0)),
+    m_dropNext (Seconds (0)),
+    m_count (0),
+    m_lastCount (0)
 {
 }
 
@@ -85,27 +123,28 @@ SpcMacQueue::~SpcMacQueue ()
 }
 
 uint32_t
-SpcMacQueue::Aggregation (Mac48Address addr, uint16_t port, uint32_t pktNum)
+SpcMacQueue::Aggregation (Mac48Address addr, uint16_t port, uint32_t pktNum,
+                          std::list<Ptr<const Packet> > *packets)
 {
-  PacketQueueI it = m_queue.begin ();
   uint32_t cutNum = 0;
   uint32_t size = 0;
   pktNum--;
-  while (it != m_queue.end ())
+  while (pktNum > cutNum)
     {
-      SpcMacHeader hdr = it->hdr;
-      PacketInfo packetInfo;
-      packetInfo.SetPacketInfo (it->packet->Copy ());
-      if (hdr.GetAddr1 () ==  addr && packetInfo.GetDestPort () == port && pktNum > cutNum)
+      DestinationIndex::iterator destination = m_index.find (Destination (addr, port));
+      if (destination == m_index.end ())
+        {
+          break;
+        }
+      PacketQueueI it = destination->second.front ();
+      cutNum ++;
+      size += it->info.GetSize ();
+      packets->push_back (it->packet);
+      if (!it->requeued)
         {
-          cutNum ++;
-          size += packetInfo.GetSize ();
-          m_queue.erase (it++);
-          m_size--;
+          m_sojournTrace (Simulator::Now () - it->tstamp);
         }
-      else{
-        it++;
-      }
+      Erase (it);
     }
   return size;
 }
@@ -129,10 +168,14 @@ SpcMacQueue::Enqueue (Ptr<const Packet> packet, const SpcMacHeader &hdr)
   Cleanup ();
   if (m_size == m_maxSize)
     {
+      m_dropTrace (packet);
       return;
     }
   Time now = Simulator::Now ();
-  m_queue.push_back (Item (packet, hdr, now));
+  PacketInfo info;
+  info.SetPacketInfo (packet->Copy ());
+  m_queue.push_back (Item (packet, hdr, now, info));
+  m_index[Destination (hdr.GetAddr1 (), info.GetDestPort ())].push_back (--m_queue.end ());
   if (!hdr.GetAddr1 ().IsGroup ())
     {
       m_nodeTable->AddSize (hdr.GetAddr1 (), packet->GetSize ());
@@ -140,16 +183,63 @@ SpcMacQueue::Enqueue (Ptr<const Packet> packet, const SpcMacHeader &hdr)
   m_size++;
 }
 
+void
+SpcMacQueue::PushFront (Ptr<const Packet> packet, const SpcMacHeader &hdr)
+{
+  Cleanup ();
+  if (m_size == m_maxSize)
+    {
+      m_dropTrace (packet);
+      return;
+    }
+  // not younger than the packets behind it, so that m_queue stays in
+  // order of age for Cleanup
+  Time tstamp = Simulator::Now ();
+  if (!m_queue.empty ())
+    {
+      tstamp = Min (tstamp, m_queue.front ().tstamp);
+    }
+  PacketInfo info;
+  info.SetPacketInfo (packet->Copy ());
+  m_queue.push_front (Item (packet, hdr, tstamp, info, true));
+  m_index[Destination (hdr.GetAddr1 (), info.GetDestPort ())].push_front (m_queue.begin ());
+  m_size++;
+}
+
 Ptr<const Packet>
 SpcMacQueue::Dequeue (SpcMacHeader *hdr)
 {
   Cleanup ();
+  ControlDelay ();
+  if (!m_queue.empty ())
+    {
+      Item i = m_queue.front ();
+      Erase (m_queue.begin ());
+      if (!i.requeued)
+        {
+          m_sojournTrace (Simulator::Now () - i.tstamp);
+        }
+      *hdr = i.hdr;
+      return i.packet;
+    }
+  return 0;
+}
+
+Ptr<const Packet>
+SpcMacQueue::Dequeue (SpcMacHeader *hdr, PacketInfo *info)
+{
+  Cleanup ();
+  ControlDelay ();
   if (!m_queue.empty ())
     {
       Item i = m_queue.front ();
-      m_queue.pop_front ();
-      m_size--;
+      Erase (m_queue.begin ());
+      if (!i.requeued)
+        {
+          m_sojournTrace (Simulator::Now () - i.tstamp);
+        }
       *hdr = i.hdr;
+      *info = i.info;
       return i.packet;
     }
   return 0;
@@ -168,6 +258,20 @@ SpcMacQueue::Peek (SpcMacHeader *hdr)
   return 0;
 }
 
+Ptr<const Packet>
+SpcMacQueue::PeekByDestination (Mac48Address addr, uint16_t port, SpcMacHeader *hdr)
+{
+  Cleanup ();
+  DestinationIndex::const_iterator destination = m_index.find (Destination (addr, port));
+  if (destination != m_index.end ())
+    {
+      PacketQueueI it = destination->second.front ();
+      *hdr = it->hdr;
+      return it->packet;
+    }
+  return 0;
+}
+
 bool
 SpcMacQueue::IsEmpty (void)
 {
@@ -191,6 +295,7 @@ void
 SpcMacQueue::Flush (void)
 {
   m_queue.erase (m_queue.begin (), m_queue.end ());
+  m_index.clear ();
   m_size = 0;
 }
 
@@ -202,12 +307,125 @@ SpcMacQueue::Remove (Ptr<const Packet> packet)
     {
       if (it->packet == packet)
         {
-          m_queue.erase (it);
-          m_size--;
+          Erase (it);
           return true;
         }
     }
   return false;
 }
 
+void
+SpcMacQueue::Cleanup (void)
+{
+  if (m_maxDelay.IsZero ())
+    {
+      return;
+    }
+  Time now = Simulator::Now ();
+  while (!m_queue.empty () && m_queue.front ().tstamp + m_maxDelay < now)
+    {
+      Drop (m_queue.begin ());
+    }
+}
+
+void
+SpcMacQueue::ControlDelay (void)
+{
+  if (!m_controlledDelay)
+    {
+      return;
+    }
+  Time now = Simulator::Now ();
+  bool aboveTarget = IsAboveTarget (now);
+  if (m_dropping)
+    {
+      if (!aboveTarget)
+        {
+          m_dropping = false;
+        }
+      while (m_dropping && now >= m_dropNext)
+        {
+          Drop (m_queue.begin ());
+          m_count++;
+          if (!IsAboveTarget (now))
+            {
+              m_dropping = false;
+            }
+          else
+            {
+              m_dropNext = GetNextDrop (m_dropNext);
+            }
+        }
+    }
+  else if (aboveTarget)
+    {
+      Drop (m_queue.begin ());
+      m_dropping = true;
+      // start near the drop rate of the last dropping state if it ended recently
+      uint32_t delta = m_count - m_lastCount;
+      if (delta > 1 && now - m_dropNext < Seconds (16 * m_interval.GetSeconds ()))
+        {
+          m_count = delta;
+        }
+      else
+        {
+          m_count = 1;
+        }
+      m_dropNext = GetNextDrop (now);
+      m_lastCount = m_count;
+    }
+}
+
+bool
+SpcMacQueue::IsAboveTarget (Time now)
+{
+  // a single packet is not a standing queue
+  if (m_size <= 1 || now - m_queue.front ().tstamp < m_target)
+    {
+      m_firstAboveTime = Seconds (0);
+      return false;
+    }
+  if (m_firstAboveTime.IsZero ())
+    {
+      m_firstAboveTime = now + m_interval;
+      return false;
+    }
+  return now >= m_firstAboveTime;
+}
+
+Time
+SpcMacQueue::GetNextDrop (Time t) const
+{
+  return t + Seconds (m_interval.GetSeconds () / std::sqrt ((double)m_count));
+}
+
+void
+SpcMacQueue::Erase (PacketQueueI it)
+{
+  DestinationIndex::iterator destination = m_index.find (Destination (it->hdr.GetAddr1 (), it->info.GetDestPort ()));
+  NS_ASSERT (destination != m_index.end ());
+  std::deque<PacketQueueI> &items = destination->second;
+  if (items.front () == it)
+    {
+      items.pop_front ();
+    }
+  else
+    {
+      items.erase (std::find (items.begin (), items.end (), it));
+    }
+  if (items.empty ())
+    {
+      m_index.erase (destination);
+    }
+  m_queue.erase (it);
+  m_size--;
+}
+
+void
+SpcMacQueue::Drop (PacketQueueI it)
+{
+  m_dropTrace (it->packet);
+  Erase (it);
+}
+
 } // namespace ns3
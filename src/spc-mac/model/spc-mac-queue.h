@@ -44,12 +44,17 @@
 #define SPC_MAC_QUEUE_H
 
 #include <list>
+#include <deque>
+#include <map>
 #include <utility>
 #include "ns3/packet.h"
 #include "ns3/nstime.h"
 #include "ns3/object.h"
+#include "ns3/traced-callback.h"
+#include "ns3/mac48-address.h"
 #include "spc-mac-header.h"
 #include "node-information-table.h"
+#include "packet-info.h"
 
 
 namespace ns3 {
@@ -65,16 +70,27 @@ public:
   void SetMaxSize (uint32_t maxSize);
   uint32_t GetMaxSize (void) const;
   void Enqueue (Ptr<const Packet> packet, const SpcMacHeader &hdr);
+  /// Put packet back at the head of the queue, ahead of its destination
   void PushFront (Ptr<const Packet> packet, const SpcMacHeader &hdr);
   Ptr<const Packet> Dequeue (SpcMacHeader *hdr);
+  /// As Dequeue, also returning the headers parsed at Enqueue
+  Ptr<const Packet> Dequeue (SpcMacHeader *hdr, PacketInfo *info);
   Ptr<const Packet> Peek (SpcMacHeader *hdr);
+  /// Oldest packet to port at addr, or 0
+  Ptr<const Packet> PeekByDestination (Mac48Address addr, uint16_t port, SpcMacHeader *hdr);
   bool Remove (Ptr<const Packet> packet);
   void Flush (void);
   bool IsEmpty (void);
   uint32_t GetSize (void);
 
   void SetNodeTable(Ptr<NodeInformationTable> nodeTable);
-  uint32_t Aggregation (Mac48Address addr, uint16_t port, uint32_t pktNum);
+  /**
+   * Remove the pktNum - 1 oldest packets to port at addr, which are sent
+   * along with the packet already dequeued, append them to packets and
+   * return their size.
+   */
+  uint32_t Aggregation (Mac48Address addr, uint16_t port, uint32_t pktNum,
+                        std::list<Ptr<const Packet> > *packets);
 protected:
 
   struct Item;
@@ -87,16 +103,64 @@ protected:
   {
     Item (Ptr<const Packet> packet,
           const SpcMacHeader &hdr,
-          Time tstamp);
+          Time tstamp,
+          const PacketInfo &info,
+          bool requeued = false);
     Ptr<const Packet> packet;
     SpcMacHeader hdr;
     Time tstamp;
+    /// headers, destination port and payload size, parsed once at Enqueue
+    PacketInfo info;
+    /**
+     * Put back by PushFront: its size was already counted by the node
+     * table and its sojourn traced when it was first dequeued
+     */
+    bool requeued;
   };
 
+  /**
+   * Items of one (destination, port) in arrival order, alongside the
+   * global order of m_queue.  The head of m_queue is always the head
+   * of its destination, as is every item dropped by Cleanup or
+   * ControlDelay.
+   */
+  typedef std::pair<Mac48Address, uint16_t> Destination;
+  typedef std::map<Destination, std::deque<PacketQueueI> > DestinationIndex;
+
+  /// Drop the packets which have waited longer than m_maxDelay
+  void Cleanup (void);
+  /**
+   * CoDel: once the sojourn time of the head has stayed above m_target
+   * for m_interval, drop heads at intervals shrinking with the square
+   * root of the number of drops, until it falls below m_target again
+   */
+  void ControlDelay (void);
+  /// Whether the sojourn time of the head has been above m_target for m_interval
+  bool IsAboveTarget (Time now);
+  Time GetNextDrop (Time t) const;
+  /// Remove it from m_queue and from the index
+  void Erase (PacketQueueI it);
+  void Drop (PacketQueueI it);
+
   Ptr<NodeInformationTable> m_nodeTable;
   PacketQueue m_queue;
+  DestinationIndex m_index;
   uint32_t m_size;
   uint32_t m_maxSize;
+  Time m_maxDelay;
+
+  bool m_controlledDelay;
+  Time m_target;
+  Time m_interval;
+  /// CoDel state
+  bool m_dropping;
+  Time m_firstAboveTime;
+  Time m_dropNext;
+  uint32_t m_count;
+  uint32_t m_lastCount;
+
+  TracedCallback<Ptr<const Packet> > m_dropTrace;
+  TracedCallback<Time> m_sojournTrace;
 };
 
 } // namespace ns3
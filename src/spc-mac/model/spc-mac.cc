@@ -24,6 +24,7 @@
 #include "ns3/log.h"
 #include "spc-mac-header.h"
 #include "spc-mac-trailer.h"
+#include "spc-amsdu-subframe-header.h"
 #include "spc-mac.h"
 #include "ns3/math.h"
 
@@ -60,11 +61,11 @@ public:
   {
     m_spcMac->NotifyRxStartNow (duration);
   }
-  virtual void NotifyRxEndOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
+  virtual void NotifyRxEndOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes)
   {
-    m_spcMac->ReceiveOk (packet, rssi, spcNum);
+    m_spcMac->ReceiveOk (packet, rssi, spcNum, subframes);
   }
-  virtual void NotifyRxEndError (Ptr<Packet> packet)
+  virtual void NotifyRxEndError (Ptr<const Packet> packet)
   {
     m_spcMac->ReceiveError (packet);
   }
@@ -113,7 +114,11 @@ SpcMac::SpcMac ()
     m_ctsTimeoutEvent (),
     m_backoffTimeoutEvent (),
     m_backoffGrantStartEvent(),
-    m_measureTrafficEvent ()
+    m_measureTrafficEvent (),
+    m_powerSolver (POWER_BISECTION),
+    m_powerPrecision (1e-6),
+    m_pairingCacheSize (1024),
+    m_pairingResolutionDb (0.1)
 {
   NS_LOG_FUNCTION (this);
   SpcPreamble preamble;
@@ -155,10 +160,130 @@ SpcMac::GetTypeId (void)
                    UintegerValue (6000000 / 8),
                    MakeUintegerAccessor (&SpcMac::m_rate),
                    MakeUintegerChecker<uint32_t>(0))
+    .AddAttribute ("CapacityLog2",
+                   "log2 used for the Shannon capacity when choosing rates and power splits.",
+                   EnumValue (SpcCapacity::EXACT),
+                   MakeEnumAccessor (&SpcMac::SetCapacityMode,
+                                     &SpcMac::GetCapacityMode),
+                   MakeEnumChecker (SpcCapacity::EXACT, "Exact",
+                                    SpcCapacity::FAST, "Fast"))
+    .AddAttribute ("PowerSolver",
+                   "Search for the power split of a superposed frame.",
+                   EnumValue (SpcMac::POWER_BISECTION),
+                   MakeEnumAccessor (&SpcMac::SetPowerSolver,
+                                     &SpcMac::GetPowerSolver),
+                   MakeEnumChecker (SpcMac::POWER_SWEEP, "Sweep",
+                                    SpcMac::POWER_BISECTION, "Bisection",
+                                    SpcMac::POWER_TABLE, "Table"))
+    .AddAttribute ("PowerPrecision",
+                   "Width of the power split interval at which the bisection stops.",
+                   DoubleValue (1e-6),
+                   MakeDoubleAccessor (&SpcMac::SetPowerPrecision,
+                                       &SpcMac::GetPowerPrecision),
+                   MakeDoubleChecker<double> (1e-9, 0.01))
+    .AddAttribute ("PowerTableFile",
+                   "File the power split table of the Table solver is mapped from and saved to, empty to keep it in memory.",
+                   StringValue (""),
+                   MakeStringAccessor (&SpcMac::SetPowerTableFile,
+                                       &SpcMac::GetPowerTableFile),
+                   MakeStringChecker ())
+    .AddAttribute ("PairingCacheSize",
+                   "Number of packet counts chosen by GetWaitTimeForBuffer kept per MAC, 0 to disable.",
+                   UintegerValue (1024),
+                   MakeUintegerAccessor (&SpcMac::m_pairingCacheSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("PairingCacheResolution",
+                   "Step (dB) to which path losses are rounded for the pairing cache.",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&SpcMac::SetPairingCacheResolution,
+                                       &SpcMac::GetPairingCacheResolution),
+                   MakeDoubleChecker<double> (1e-6))
   ;
   return tid;
 }
 
+void
+SpcMac::SetCapacityMode (SpcCapacity::Log2Mode mode)
+{
+  m_capacity.SetMode (mode);
+  FlushPairingCache (true);
+}
+
+SpcCapacity::Log2Mode
+SpcMac::GetCapacityMode () const
+{
+  return m_capacity.GetMode ();
+}
+
+void
+SpcMac::SetPowerSolver (PowerSolver solver)
+{
+  m_powerSolver = solver;
+  FlushPairingCache (false);
+}
+
+SpcMac::PowerSolver
+SpcMac::GetPowerSolver () const
+{
+  return m_powerSolver;
+}
+
+void
+SpcMac::SetPowerPrecision (double precision)
+{
+  m_powerPrecision = precision;
+  FlushPairingCache (false);
+}
+
+double
+SpcMac::GetPowerPrecision () const
+{
+  return m_powerPrecision;
+}
+
+void
+SpcMac::SetPowerTableFile (std::string fileName)
+{
+  m_powerTableFile = fileName;
+  FlushPairingCache (true);
+}
+
+std::string
+SpcMac::GetPowerTableFile () const
+{
+  return m_powerTableFile;
+}
+
+void
+SpcMac::SetPairingCacheResolution (double resolutionDb)
+{
+  m_pairingResolutionDb = resolutionDb;
+  FlushPairingCache (false);
+}
+
+double
+SpcMac::GetPairingCacheResolution () const
+{
+  return m_pairingResolutionDb;
+}
+
+uint32_t
+SpcMac::GetPairingCacheEntries () const
+{
+  return m_pairingCache.size ();
+}
+
+void
+SpcMac::FlushPairingCache (bool powerTable)
+{
+  m_pairingCache.clear ();
+  m_pairingOrder.clear ();
+  if (powerTable)
+    {
+      m_powerTable = 0;
+    }
+}
+
 int64_t
 SpcMac::AssignStreams (int64_t stream)
 {
@@ -198,6 +323,12 @@ SpcMac::GetPhy ()
   return m_phy;
 }
 
+Ptr<SpcMacQueue>
+SpcMac::GetQueue ()
+{
+  return m_queue;
+}
+
 Mac48Address
 SpcMac::GetAddress (){
   return m_address;
@@ -331,14 +462,16 @@ SpcMac::InitSend ()
 }
 
 void
-SpcMac::ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
+SpcMac::ReceiveOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes)
 {
   NS_LOG_FUNCTION (this << rssi);
 
   m_rxing = false;
 
+  // the frame is shared by every receiver of the transmission: only
+  // peek at the header here and copy the payload when it goes up
   SpcMacHeader hdr;
-  packet->RemoveHeader (hdr);
+  packet->PeekHeader (hdr);
   NS_LOG_DEBUG (hdr);
 
   // Set Nav
@@ -406,17 +539,21 @@ SpcMac::ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
     case SPC_MAC_DATA:
       if (hdr.GetAddr1 () == GetAddress () && !hdr.GetAddr1 ().IsGroup ())
 	{
+	  Ptr<Packet> copy = packet->Copy ();
+	  copy->RemoveHeader (hdr);
+	  uint16_t bitmap = ForwardUp (copy, hdr.IsAggregate (), hdr.GetAddr1 (), hdr.GetAddr2 (), subframes);
 	  m_sendAckAfterDataEvent = Simulator::Schedule (m_sifs,
 							 &SpcMac::SendAckAfterData,
 							 this,
 							 hdr.GetAddr2 (),
-							 SpcMacHeader::FIRST);
-
-	  m_device->Receive (packet, hdr.GetAddr1 (), hdr.GetAddr2 ());
+							 SpcMacHeader::FIRST,
+							 bitmap);
 	}
       if (hdr.GetAddr1 ().IsGroup ())
 	{
-	  m_device->Receive (packet, hdr.GetAddr1 (), hdr.GetAddr2 ());
+	  Ptr<Packet> copy = packet->Copy ();
+	  copy->RemoveHeader (hdr);
+	  ForwardUp (copy, hdr.IsAggregate (), hdr.GetAddr1 (), hdr.GetAddr2 (), subframes);
 	}
       break;
       
@@ -470,33 +607,35 @@ SpcMac::ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
       NS_ASSERT(!hdr.GetAddr1 ().IsGroup () && !hdr.GetAddr2 ().IsGroup ());
       if (spcNum == SpcMacHeader::FIRST && hdr.GetAddr1 () == GetAddress ())
 	{
+	  Ptr<Packet> copy = packet->Copy ();
+	  copy->RemoveHeader (hdr);
 	  NS_LOG_DEBUG ("Receive SPC DATA: to=" << hdr.GetAddr1 () <<
 			", from=" << hdr.GetAddr3 () <<
-			", size=" << packet->GetSize ());
-	  PacketInfo packetInfo;
-	  packetInfo.SetPacketInfo (packet);
+			", size=" << copy->GetSize ());
 	  m_waitTime = Max (m_waitTime, Simulator::Now () + m_ackSendAndSifsTime * 2 + m_sifs);
+	  uint16_t bitmap = ForwardUp (copy, hdr.IsAggregate (), hdr.GetAddr1 (), hdr.GetAddr3 (), subframes);
 	  m_sendAckAfterDataEvent = Simulator::Schedule (m_sifs,
 							 &SpcMac::SendAckAfterData,
 							 this,
 							 hdr.GetAddr3 (),
-							 SpcMacHeader::FIRST);
-	  m_device->Receive (packet, hdr.GetAddr1 (), hdr.GetAddr3 ());
+							 SpcMacHeader::FIRST,
+							 bitmap);
 	}
       else if (spcNum == SpcMacHeader::SECOND && hdr.GetAddr2 () == GetAddress ())
 	{
+	  Ptr<Packet> copy = packet->Copy ();
+	  copy->RemoveHeader (hdr);
 	  NS_LOG_DEBUG ("Receive SPC DATA: to=" << hdr.GetAddr2 () <<
 			", from=" << hdr.GetAddr3 () <<
-			", size=" << packet->GetSize ());
-	  PacketInfo packetInfo;
-	  packetInfo.SetPacketInfo (packet);
+			", size=" << copy->GetSize ());
 	  m_waitTime = Max (m_waitTime, Simulator::Now () + m_ackSendAndSifsTime * 2 + m_sifs);
+	  uint16_t bitmap = ForwardUp (copy, hdr.IsAggregate (), hdr.GetAddr2 (), hdr.GetAddr3 (), subframes);
 	  m_sendAckAfterDataEvent = Simulator::Schedule (m_ackSendAndSifsTime + m_sifs,
 							 &SpcMac::SendAckAfterData,
 							 this,
 							 hdr.GetAddr3 (),
-							 SpcMacHeader::SECOND);
-	  m_device->Receive (packet, hdr.GetAddr2 (), hdr.GetAddr3 ());
+							 SpcMacHeader::SECOND,
+							 bitmap);
 	}
       break;
       
@@ -509,12 +648,14 @@ SpcMac::ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
 	    {
 	      NS_LOG_DEBUG ("receive Ack: state first");
 	      m_ackTimeoutEvent1.Cancel ();
+	      RequeueLost (SpcMacHeader::FIRST, hdr.GetBlockAck ());
 	      m_currentPacket1 = 0;
 	    }
 	  else if (m_sendState == SECOND)
 	    {
 	      NS_LOG_DEBUG ("receive Ack: state second");
 	      m_ackTimeoutEvent2.Cancel ();
+	      RequeueLost (SpcMacHeader::SECOND, hdr.GetBlockAck ());
 	      m_currentPacket2 = 0;
 	    }
 	  else if (m_sendState == SPC)
@@ -523,11 +664,13 @@ SpcMac::ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
 	      if (spcNum == SpcMacHeader::FIRST)
 		{
 		  m_ackTimeoutEvent1.Cancel ();
+		  RequeueLost (SpcMacHeader::FIRST, hdr.GetBlockAck ());
 		  m_currentPacket1 = 0;
 		}
 	      else if(spcNum == SpcMacHeader::SECOND)
 		{
 		  m_ackTimeoutEvent2.Cancel ();
+		  RequeueLost (SpcMacHeader::SECOND, hdr.GetBlockAck ());
 		  m_currentPacket2 = 0;
 		}
 	      else
@@ -544,13 +687,13 @@ SpcMac::ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
 }
 
 void
-SpcMac::ReceiveError (Ptr<Packet> packet)
+SpcMac::ReceiveError (Ptr<const Packet> packet)
 {
   NS_LOG_FUNCTION (this);
   m_rxing = false;
 
   SpcMacHeader hdr;
-  packet->RemoveHeader (hdr);
+  packet->PeekHeader (hdr);
   NS_LOG_DEBUG (hdr);
 }
 
@@ -558,7 +701,7 @@ SpcMac::ReceiveError (Ptr<Packet> packet)
 struct SpcMac::TimeRate
 SpcMac::CalculateTimeRate (double passLoss, uint32_t size, uint32_t bandwidth)
 {
-  double optRate = bandwidth * log2 (1 + (passLoss / GetNoiseFloor (bandwidth))) / 8;
+  double optRate = m_capacity.GetCapacity (bandwidth, passLoss / GetNoiseFloor (bandwidth)) / 8;
   NS_LOG_DEBUG ("passLoss: "    << passLoss  <<
 		", noise: "     << GetNoiseFloor (bandwidth) <<
 		", ratio: "     << (passLoss / GetNoiseFloor (bandwidth)) <<
@@ -575,10 +718,6 @@ SpcMac::CalculateTimeRate (double passLoss, uint32_t size, uint32_t bandwidth)
 struct SpcMac::PowerTimeRate
 SpcMac::CalculatePowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2, uint32_t bandwidth, bool *isFar)
 {
-  double minEndTime = sizeof(double);
-  double optPower = 0;
-  uint32_t optRate = 0;
-
   if (passLoss1 < passLoss2)
     {
       *isFar = true;
@@ -587,28 +726,75 @@ SpcMac::CalculatePowerTimeRate (double passLoss1, double passLoss2, uint32_t siz
     {
       *isFar = false;
     }
+  double noiseFloor = GetNoiseFloor (bandwidth);
+  struct PowerTimeRate powerTimeRate;
+  if (m_powerSolver == POWER_SWEEP)
+    {
+      powerTimeRate = SweepPowerTimeRate (passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, *isFar);
+    }
+  else if (m_powerSolver == POWER_TABLE)
+    {
+      powerTimeRate = TablePowerTimeRate (passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, *isFar);
+    }
+  else
+    {
+      powerTimeRate = BisectPowerTimeRate (passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, *isFar);
+    }
+  NS_LOG_DEBUG ("passLoss1: "    << passLoss1  <<
+		", passLoss2: "  << passLoss2  <<
+		", size1: "      << size1      <<
+		", size2: "      << size2      <<
+		", bandwidth: "  << bandwidth  <<
+		", optRate: "    << powerTimeRate.rate  <<
+		", optPower: "   << powerTimeRate.power <<
+		", minTime:"     << powerTimeRate.time);
+
+  return powerTimeRate;
+}
+
+struct SpcMac::PowerTimeRate
+SpcMac::SweepPowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+			    uint32_t bandwidth, double noiseFloor, bool isFar)
+{
+  double minEndTime = sizeof(double);
+  double optPower = 0;
+  uint32_t optRate = 0;
+
+  m_powers.clear ();
+  m_t1.clear ();
+  m_t2.clear ();
   for (double power = 0.1; power < 1.0; power += 0.01)
     {
       double pow1 = power;
       double pow2 = 1 - power;
       double t1, t2;
       //      if (pow1 >= 0.5)
-      if (*isFar)
+      if (isFar)
 	{
-	  t1 = (pow1 * passLoss1) / (pow2 * passLoss1 + GetNoiseFloor (bandwidth));
-	  t2 = (pow2 * passLoss2) / GetNoiseFloor (bandwidth);
+	  t1 = (pow1 * passLoss1) / (pow2 * passLoss1 + noiseFloor);
+	  t2 = (pow2 * passLoss2) / noiseFloor;
 	}
       else
 	{
-	  t1 = (pow1 * passLoss1) / GetNoiseFloor (bandwidth);
-	  t2 = (pow2 * passLoss2) / (pow1 * passLoss2 + GetNoiseFloor (bandwidth));
+	  t1 = (pow1 * passLoss1) / noiseFloor;
+	  t2 = (pow2 * passLoss2) / (pow1 * passLoss2 + noiseFloor);
 	}
-      double capacity1 = bandwidth * log2 (1 + t1) / 8;
-      double capacity2 = bandwidth * log2 (1 + t2) / 8;
+      m_powers.push_back (power);
+      m_t1.push_back (t1);
+      m_t2.push_back (t2);
+    }
+  // log2 (1 + t) of every step in one batch
+  uint32_t n = m_powers.size ();
+  m_capacity.GetEfficiency (&m_t1[0], &m_t1[0], n);
+  m_capacity.GetEfficiency (&m_t2[0], &m_t2[0], n);
+  for (uint32_t k = 0; k < n; k++)
+    {
+      double capacity1 = bandwidth * m_t1[k] / 8;
+      double capacity2 = bandwidth * m_t2[k] / 8;
       double currentEndTime = std::max (size1 / capacity1, size2 / capacity2);
       if (currentEndTime < minEndTime)
 	{
-	  optPower = power;
+	  optPower = m_powers[k];
 	  minEndTime = currentEndTime;
 	  if (size1 / capacity1 > size2 / capacity2)
 	    {
@@ -625,18 +811,106 @@ SpcMac::CalculatePowerTimeRate (double passLoss1, double passLoss2, uint32_t siz
   powerTimeRate.power = optPower;
   powerTimeRate.rate  = optRate;
   powerTimeRate.time  = Seconds (minEndTime);
-  NS_LOG_DEBUG ("passLoss1: "    << passLoss1  <<
-		", passLoss2: "  << passLoss2  <<
-		", size1: "      << size1      <<
-		", size2: "      << size2      <<
-		", bandwidth: "  << bandwidth  <<
-		", optRate: "    << optRate    <<
-		", optPower: "   << optPower   <<
-		", minTime:"     << Seconds (minEndTime));
+  return powerTimeRate;
+}
 
+struct SpcMac::PowerTimeRate
+SpcMac::BisectPowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+			     uint32_t bandwidth, double noiseFloor, bool isFar)
+{
+  // same range as the sweep; layer 2 gets no power at 1
+  double low = 0.1;
+  double high = 1.0;
+  double time1, time2;
+  GetLayerTimes (low, passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, isFar, &time1, &time2);
+  if (time1 > time2)
+    {
+      // keep time1 (low) > time2 (low) and time1 (high) <= time2 (high)
+      while (high - low > m_powerPrecision)
+	{
+	  double middle = (low + high) / 2;
+	  GetLayerTimes (middle, passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, isFar, &time1, &time2);
+	  if (time1 > time2)
+	    {
+	      low = middle;
+	    }
+	  else
+	    {
+	      high = middle;
+	    }
+	}
+    }
+  else
+    {
+      high = low;
+    }
+
+  // the best split is at one end of the last interval
+  double lowTime1, lowTime2, highTime1, highTime2;
+  GetLayerTimes (low, passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, isFar, &lowTime1, &lowTime2);
+  GetLayerTimes (high, passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, isFar, &highTime1, &highTime2);
+  double optPower = low;
+  time1 = lowTime1;
+  time2 = lowTime2;
+  if (std::max (highTime1, highTime2) < std::max (lowTime1, lowTime2))
+    {
+      optPower = high;
+      time1 = highTime1;
+      time2 = highTime2;
+    }
+
+  struct PowerTimeRate powerTimeRate;
+  powerTimeRate.power = optPower;
+  powerTimeRate.rate  = (uint32_t)(time1 > time2 ? size1 / time1 : size2 / time2);
+  powerTimeRate.time  = Seconds (std::max (time1, time2));
   return powerTimeRate;
 }
 
+struct SpcMac::PowerTimeRate
+SpcMac::TablePowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+			    uint32_t bandwidth, double noiseFloor, bool isFar)
+{
+  if (m_powerTable == 0)
+    {
+      m_powerTable = SpcPowerAllocationTable::Get (m_powerTableFile, m_capacity.GetMode ());
+    }
+  double power;
+  if (!m_powerTable->GetPower (passLoss1 / noiseFloor, passLoss2 / noiseFloor, size1, size2, isFar, &power))
+    {
+      return BisectPowerTimeRate (passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, isFar);
+    }
+  // the airtime and rate are exact for the interpolated split
+  double time1, time2;
+  GetLayerTimes (power, passLoss1, passLoss2, size1, size2, bandwidth, noiseFloor, isFar, &time1, &time2);
+
+  struct PowerTimeRate powerTimeRate;
+  powerTimeRate.power = power;
+  powerTimeRate.rate  = (uint32_t)(time1 > time2 ? size1 / time1 : size2 / time2);
+  powerTimeRate.time  = Seconds (std::max (time1, time2));
+  return powerTimeRate;
+}
+
+void
+SpcMac::GetLayerTimes (double power, double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+		       uint32_t bandwidth, double noiseFloor, bool isFar, double *time1, double *time2) const
+{
+  double pow1 = power;
+  double pow2 = 1 - power;
+  double t1, t2;
+  if (isFar)
+    {
+      t1 = (pow1 * passLoss1) / (pow2 * passLoss1 + noiseFloor);
+      t2 = (pow2 * passLoss2) / noiseFloor;
+    }
+  else
+    {
+      t1 = (pow1 * passLoss1) / noiseFloor;
+      t2 = (pow2 * passLoss2) / (pow1 * passLoss2 + noiseFloor);
+    }
+  *time1 = size1 / (bandwidth * m_capacity.GetEfficiency (t1) / 8);
+  *time2 = size2 / (bandwidth * m_capacity.GetEfficiency (t2) / 8);
+}
+
 struct SpcMac::TimeNum1Num2
 SpcMac::GetWaitTimeForBuffer (void)
 {
@@ -657,37 +931,84 @@ SpcMac::GetWaitTimeForBuffer (void)
       return tnn;
     }
 
-  SpcPreamble preamble;
+  GetPacketNums (passLoss1, passLoss2, size1, size2, &tnn);
+
+  uint32_t s1 = GetSpcFrameSize (size1, tnn.num1);
+  uint32_t s2 = GetSpcFrameSize (size2, tnn.num2);
+  tnn.time = std::max(Seconds (double(s1) / traffic1),
+		      Seconds (double(s2) / traffic2));
+
+  return tnn;
+}
+
+uint32_t
+SpcMac::GetSpcFrameSize (uint32_t size, uint32_t num) const
+{
   SpcMacHeader hdr;
   hdr.SetType (SPC_MAC_DATA_SPC);
   SpcMacTrailer fcs;
-  tnn.time = Seconds (10000);
+  SpcAmsduSubframeHeader subhdr;
+  // an aggregate of several packets adds a subframe header to each
+  return (num > 1 ? (size + subhdr.GetSerializedSize ()) * num : size) + hdr.GetSize () + fcs.GetSize ();
+}
+
+void
+SpcMac::GetPacketNums (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2, TimeNum1Num2 *tnn)
+{
+  if (m_pairingCacheSize == 0)
+    {
+      SearchPacketNums (passLoss1, passLoss2, size1, size2, tnn);
+      return;
+    }
+  int32_t step1 = (int32_t)std::floor (10 * std::log10 (passLoss1) / m_pairingResolutionDb + 0.5);
+  int32_t step2 = (int32_t)std::floor (10 * std::log10 (passLoss2) / m_pairingResolutionDb + 0.5);
+  PairingKey key (std::make_pair (step1, step2), std::make_pair (size1, size2));
+  PairingCache::const_iterator cached = m_pairingCache.find (key);
+  if (cached != m_pairingCache.end ())
+    {
+      tnn->num1 = cached->second.first;
+      tnn->num2 = cached->second.second;
+      return;
+    }
+  SearchPacketNums (std::pow (10.0, step1 * m_pairingResolutionDb / 10),
+		    std::pow (10.0, step2 * m_pairingResolutionDb / 10),
+		    size1, size2, tnn);
+  while (m_pairingCache.size () >= m_pairingCacheSize)
+    {
+      m_pairingCache.erase (m_pairingOrder.front ());
+      m_pairingOrder.pop_front ();
+    }
+  m_pairingOrder.push_back (m_pairingCache.insert (std::make_pair (key, std::make_pair (tnn->num1, tnn->num2))).first);
+}
+
+void
+SpcMac::SearchPacketNums (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2, TimeNum1Num2 *tnn)
+{
+  tnn->time = Seconds (10000);
+  // the airtime grows with the number of packets of either layer: once a
+  // cell is slower than the best one, so is every cell after it
   for (uint32_t i = 1; i <= m_restrictionPacketNum; i++)
     {
       for (uint32_t j = 1; j <= m_restrictionPacketNum; j++)
 	{
 	  bool isFar;
 	  struct SpcMac::PowerTimeRate ptr;
-	  uint32_t s1 = size1 * i + hdr.GetSize () + fcs.GetSize (); 
-	  uint32_t s2 = size2 * j + hdr.GetSize () + fcs.GetSize (); 
 	  ptr = CalculatePowerTimeRate (passLoss1, passLoss2,
-					s1, s2,
-					preamble.GetBandwidth (), &isFar);
-	  if(ptr.time <= tnn.time)
+					GetSpcFrameSize (size1, i), GetSpcFrameSize (size2, j),
+					m_phy->GetBandwidth (), &isFar);
+	  if (ptr.time > tnn->time)
 	    {
-	      tnn.num1 = i;
-	      tnn.num2 = j;
-	      tnn.time   = ptr.time;
+	      if (j == 1)
+		{
+		  return;
+		}
+	      break;
 	    }
+	  tnn->num1 = i;
+	  tnn->num2 = j;
+	  tnn->time = ptr.time;
 	}
     }
-
-  uint32_t s1 = size1 * tnn.num1 + hdr.GetSize () + fcs.GetSize (); 
-  uint32_t s2 = size2 * tnn.num2 + hdr.GetSize () + fcs.GetSize (); 
-  tnn.time = std::max(Seconds (double(s1) / traffic1),
-		      Seconds (double(s2) / traffic2));
-
-  return tnn;
 }
 
 void
@@ -798,12 +1119,14 @@ SpcMac::SendUnicastDataAfterCts ()
   if (m_sendState == FIRST)
     {
       hdr.SetAddr1 (m_currentHdr1.GetAddr1 ());
-      packet = packetInfo1.CreatePacket ();
+      packet = CreateFrameBody (SpcMacHeader::FIRST);
+      hdr.SetAggregate (!m_aggregate1.empty ());
     }
   else if (m_sendState == SECOND)
     {
       hdr.SetAddr1 (m_currentHdr2.GetAddr1 ());
-      packet = packetInfo2.CreatePacket ();
+      packet = CreateFrameBody (SpcMacHeader::SECOND);
+      hdr.SetAggregate (!m_aggregate2.empty ());
     }
   hdr.SetAddr2 (GetAddress ());
   hdr.SetDuration (m_ackSendAndSifsTime);
@@ -815,13 +1138,14 @@ SpcMac::SendUnicastDataAfterCts ()
   SpcPreamble preamble;
   double passLoss = m_nodeTable->GetPassLoss (hdr.GetAddr1 ());
   m_powerRate = 1.0;
-  TimeRate uni = CalculateTimeRate (passLoss, packet->GetSize (), preamble.GetBandwidth ());
+  TimeRate uni = CalculateTimeRate (passLoss, packet->GetSize (), m_phy->GetBandwidth ());
   m_rate = uni.rate; 
   preamble.SetRate (m_rate);
   preamble.SetPower (m_powerRate);
   preamble.SetSymbols (packet->GetSize ());
   preamble.SetNLength (packet->GetSize () - hdr.GetSize ());
   preamble.SetFLength (packet->GetSize () - hdr.GetSize ());
+  preamble.SetNSubframes (GetSubframeBounds (m_sendState == FIRST ? SpcMacHeader::FIRST : SpcMacHeader::SECOND));
   NS_LOG_DEBUG ("Rate: "     << m_rate <<
 		", size: "   << packet->GetSize () <<
 		", symbol: " << preamble.GetSymbols () <<
@@ -908,8 +1232,8 @@ SpcMac::SendSpcDataAfterCtsSpc ()
   NS_ASSERT (m_ackTimeoutEvent1.IsExpired ());
   NS_ASSERT (m_ackTimeoutEvent2.IsExpired ());
 
-  Ptr<Packet> packet1 = packetInfo1.CreatePacket ();
-  Ptr<Packet> packet2 = packetInfo2.CreatePacket ();
+  Ptr<Packet> packet1 = CreateFrameBody (SpcMacHeader::FIRST);
+  Ptr<Packet> packet2 = CreateFrameBody (SpcMacHeader::SECOND);
   SpcPreamble preamble;
   SpcMacHeader hdrUni, hdrSpc;
   SpcMacTrailer fcs;
@@ -922,13 +1246,13 @@ SpcMac::SendSpcDataAfterCtsSpc ()
 						     passLoss2,
 						     packet1->GetSize () + hdrSpc.GetSize () + fcs.GetSize (),
 						     packet2->GetSize () + hdrSpc.GetSize () + fcs.GetSize (),
-						     preamble.GetBandwidth (), &isFar);
+						     m_phy->GetBandwidth (), &isFar);
   struct TimeRate uni1 = CalculateTimeRate (passLoss1,
 					    packet1->GetSize () + hdrUni.GetSize () + fcs.GetSize (),
-					    preamble.GetBandwidth ());
+					    m_phy->GetBandwidth ());
   struct TimeRate uni2 = CalculateTimeRate (passLoss2,
 					    packet2->GetSize () + hdrUni.GetSize () + fcs.GetSize (),
-					    preamble.GetBandwidth ());
+					    m_phy->GetBandwidth ());
   
   if (spc.time <= uni1.time + uni2.time)
     {
@@ -939,7 +1263,9 @@ SpcMac::SendSpcDataAfterCtsSpc ()
       hdr.SetAddr2 (m_currentHdr2.GetAddr1 ());
       hdr.SetAddr3 (GetAddress ());
       hdr.SetDuration (m_ackSendAndSifsTime * 2);
+      hdr.SetAggregate (!m_aggregate1.empty ());
       packet1->AddHeader (hdr);
+      hdr.SetAggregate (!m_aggregate2.empty ());
       packet2->AddHeader (hdr);
       SpcMacTrailer fcs;
       packet1->AddTrailer (fcs);
@@ -955,6 +1281,8 @@ SpcMac::SendSpcDataAfterCtsSpc ()
       preamble.SetSymbols (maxSymbols);
       preamble.SetNLength (packet1->GetSize () - m_currentHdr1.GetSize ());
       preamble.SetFLength (packet2->GetSize () - m_currentHdr2.GetSize ());
+      preamble.SetNSubframes (GetSubframeBounds (SpcMacHeader::FIRST));
+      preamble.SetFSubframes (GetSubframeBounds (SpcMacHeader::SECOND));
       
       Time txDuration = Seconds((double)preamble.GetSymbols () / preamble.GetRate ()) +
 	preamble.GetDuration () + m_maxPropagationDelay;
@@ -984,12 +1312,14 @@ SpcMac::SendUnicastDataNoAck ()
   if (m_sendState == FIRST)
     {
       hdr.SetAddr1 (m_currentHdr1.GetAddr1 ());
-      packet = packetInfo1.CreatePacket ();
+      packet = CreateFrameBody (SpcMacHeader::FIRST);
+      hdr.SetAggregate (!m_aggregate1.empty ());
     }
   else
     {
       hdr.SetAddr1 (m_currentHdr2.GetAddr1 ());
-      packet = packetInfo2.CreatePacket ();
+      packet = CreateFrameBody (SpcMacHeader::SECOND);
+      hdr.SetAggregate (!m_aggregate2.empty ());
     }
   hdr.SetType (SPC_MAC_DATA);
   hdr.SetAddr2 (GetAddress ());
@@ -1006,6 +1336,7 @@ SpcMac::SendUnicastDataNoAck ()
   preamble.SetSymbols (packet->GetSize ());
   preamble.SetNLength (packet->GetSize () - hdr.GetSize ());
   preamble.SetFLength (packet->GetSize () - hdr.GetSize ());
+  preamble.SetNSubframes (GetSubframeBounds (m_sendState == FIRST ? SpcMacHeader::FIRST : SpcMacHeader::SECOND));
 
   m_phy->StartSend (packet, preamble); 
 
@@ -1023,14 +1354,160 @@ SpcMac::SendUnicastDataNoAck ()
 
 
 
+Ptr<Packet>
+SpcMac::CreateFrameBody (uint8_t spcNum)
+{
+  Ptr<const Packet> current = spcNum == SpcMacHeader::FIRST ? m_currentPacket1 : m_currentPacket2;
+  const std::list<Ptr<const Packet> > &aggregate = spcNum == SpcMacHeader::FIRST ? m_aggregate1 : m_aggregate2;
+  if (aggregate.empty ())
+    {
+      return current->Copy ();
+    }
+  return CreateFrameBody (current, aggregate);
+}
+
+Ptr<Packet>
+SpcMac::CreateFrameBody (Ptr<const Packet> current, const std::list<Ptr<const Packet> > &aggregate) const
+{
+  Ptr<Packet> body = Create<Packet> ();
+  std::list<Ptr<const Packet> > subframes (1, current);
+  subframes.insert (subframes.end (), aggregate.begin (), aggregate.end ());
+  for (std::list<Ptr<const Packet> >::const_iterator i = subframes.begin (); i != subframes.end (); i++)
+    {
+      Ptr<Packet> subframe = (*i)->Copy ();
+      SpcAmsduSubframeHeader subhdr;
+      subhdr.SetLength (subframe->GetSize ());
+      subframe->AddHeader (subhdr);
+      body->AddAtEnd (subframe);
+    }
+  NS_LOG_DEBUG ("aggregate of " << subframes.size () << " packets, size=" << body->GetSize ());
+  return body;
+}
+
+SpcSubframeBounds
+SpcMac::GetSubframeBounds (uint8_t spcNum) const
+{
+  Ptr<const Packet> current = spcNum == SpcMacHeader::FIRST ? m_currentPacket1 : m_currentPacket2;
+  const std::list<Ptr<const Packet> > &aggregate = spcNum == SpcMacHeader::FIRST ? m_aggregate1 : m_aggregate2;
+  return GetSubframeBounds (current, aggregate);
+}
+
+SpcSubframeBounds
+SpcMac::GetSubframeBounds (Ptr<const Packet> current, const std::list<Ptr<const Packet> > &aggregate) const
+{
+  SpcSubframeBounds bounds;
+  if (aggregate.empty ())
+    {
+      return bounds;
+    }
+  SpcAmsduSubframeHeader subhdr;
+  uint32_t end = 0;
+  bounds.Add (end);
+  end += subhdr.GetSerializedSize () + current->GetSize ();
+  bounds.Add (end);
+  for (std::list<Ptr<const Packet> >::const_iterator i = aggregate.begin (); i != aggregate.end (); i++)
+    {
+      end += subhdr.GetSerializedSize () + (*i)->GetSize ();
+      bounds.Add (end);
+    }
+  return bounds;
+}
+
+uint32_t
+SpcMac::GetDataFrameSize (uint8_t spcNum) const
+{
+  Ptr<const Packet> current = spcNum == SpcMacHeader::FIRST ? m_currentPacket1 : m_currentPacket2;
+  const std::list<Ptr<const Packet> > &aggregate = spcNum == SpcMacHeader::FIRST ? m_aggregate1 : m_aggregate2;
+  SpcMacHeader hdr;
+  hdr.SetType (SPC_MAC_DATA);
+  SpcMacTrailer fcs;
+  uint32_t size = current->GetSize () + hdr.GetSize () + fcs.GetSize ();
+  if (!aggregate.empty ())
+    {
+      SpcAmsduSubframeHeader subhdr;
+      size += subhdr.GetSerializedSize ();
+      for (std::list<Ptr<const Packet> >::const_iterator i = aggregate.begin (); i != aggregate.end (); i++)
+	{
+	  size += subhdr.GetSerializedSize () + (*i)->GetSize ();
+	}
+    }
+  return size;
+}
+
+uint16_t
+SpcMac::ForwardUp (Ptr<Packet> body, bool aggregate, Mac48Address to, Mac48Address from, uint16_t received)
+{
+  if (!aggregate)
+    {
+      m_device->Receive (body, to, from);
+      return 1;
+    }
+  SpcMacTrailer fcs;
+  body->RemoveTrailer (fcs);
+  uint16_t bitmap = 0;
+  SpcAmsduSubframeHeader subhdr;
+  for (uint32_t i = 0; i < SPC_MAC_MAX_SUBFRAMES && body->GetSize () >= subhdr.GetSerializedSize (); i++)
+    {
+      body->RemoveHeader (subhdr);
+      if (subhdr.GetLength () > body->GetSize ())
+	{
+	  NS_LOG_DEBUG ("truncated subframe, length=" << subhdr.GetLength ());
+	  break;
+	}
+      if (!(received & (1 << i)))
+	{
+	  // lost in the PHY: not passed up and not acknowledged
+	  body->RemoveAtStart (subhdr.GetLength ());
+	  continue;
+	}
+      Ptr<Packet> packet = body->CreateFragment (0, subhdr.GetLength ());
+      body->RemoveAtStart (subhdr.GetLength ());
+      m_device->Receive (packet, to, from);
+      bitmap |= 1 << i;
+    }
+  return bitmap;
+}
+
+void
+SpcMac::RequeueLost (uint8_t spcNum, uint16_t bitmap)
+{
+  std::list<Ptr<const Packet> > &aggregate = spcNum == SpcMacHeader::FIRST ? m_aggregate1 : m_aggregate2;
+  if (aggregate.empty ())
+    {
+      // a frame of a single packet is acknowledged as a whole
+      return;
+    }
+  RequeueLost (spcNum == SpcMacHeader::FIRST ? m_currentPacket1 : m_currentPacket2, aggregate,
+	       spcNum == SpcMacHeader::FIRST ? m_currentHdr1 : m_currentHdr2, bitmap);
+  aggregate.clear ();
+}
+
 void
-SpcMac::SendAckAfterData (Mac48Address source, uint8_t spcNum)
+SpcMac::RequeueLost (Ptr<const Packet> current, const std::list<Ptr<const Packet> > &aggregate,
+		     const SpcMacHeader &hdr, uint16_t bitmap)
+{
+  std::vector<Ptr<const Packet> > subframes (1, current);
+  subframes.insert (subframes.end (), aggregate.begin (), aggregate.end ());
+  // last first, so that the lost subframes keep their order in the queue
+  for (uint32_t i = subframes.size (); i-- > 0; )
+    {
+      if (!(bitmap & (1 << i)))
+	{
+	  NS_LOG_DEBUG ("subframe " << i << " of " << subframes.size () << " lost");
+	  m_queue->PushFront (subframes[i], hdr);
+	}
+    }
+}
+
+void
+SpcMac::SendAckAfterData (Mac48Address source, uint8_t spcNum, uint16_t bitmap)
 {
   NS_LOG_FUNCTION (this);
 
   SpcMacHeader ack;
   ack.SetType (SPC_MAC_ACK);
   ack.SetSpcNum (spcNum);
+  ack.SetBlockAck (bitmap);
   ack.SetAddr1 (source);
   ack.SetDuration (Seconds (0));
   Ptr<Packet> packet = Create<Packet> ();
@@ -1086,13 +1563,13 @@ SpcMac::StartBackoffIfNeeded ()
   if (m_currentPacket1 == 0 && m_currentPacket2 == 0 &&
       !m_queue->IsEmpty ())
     {
-      m_currentPacket1 = m_queue->Dequeue (&m_currentHdr1);
-      packetInfo1.SetPacketInfo (m_currentPacket1->Copy ());
+      m_currentPacket1 = m_queue->Dequeue (&m_currentHdr1, &packetInfo1);
+      m_aggregate1.clear ();
+      m_aggregate2.clear ();
 
       if (!m_queue->IsEmpty ())
       {
-	m_currentPacket2 = m_queue->Dequeue (&m_currentHdr2);
-	packetInfo2.SetPacketInfo (m_currentPacket2->Copy ());
+	m_currentPacket2 = m_queue->Dequeue (&m_currentHdr2, &packetInfo2);
       }
       BackoffGrantStart ();
     }
@@ -1153,10 +1630,14 @@ SpcMac::BackoffTimeout ()
       SetState ();
       if (m_sendState == SPC)
 	{
-	  uint32_t size1 = m_queue->Aggregation (m_currentHdr1.GetAddr1 (), packetInfo1.GetDestPort (), m_tnn.num1);
-	  uint32_t size2 = m_queue->Aggregation (m_currentHdr2.GetAddr1 (), packetInfo2.GetDestPort (), m_tnn.num2);
-	  packetInfo1.SetSize (packetInfo1.GetSize () + size1);
-	  packetInfo2.SetSize (packetInfo2.GetSize () + size2);
+	  // a retry after a CTS timeout resends the frames already built
+	  if (m_aggregate1.empty () && m_aggregate2.empty ())
+	    {
+	      m_queue->Aggregation (m_currentHdr1.GetAddr1 (), packetInfo1.GetDestPort (),
+				    std::min (m_tnn.num1, SPC_MAC_MAX_SUBFRAMES), &m_aggregate1);
+	      m_queue->Aggregation (m_currentHdr2.GetAddr1 (), packetInfo2.GetDestPort (),
+				    std::min (m_tnn.num2, SPC_MAC_MAX_SUBFRAMES), &m_aggregate2);
+	    }
 	  SendRtsSpc ();
 	}
       else if (m_sendState == FIRST)
@@ -1167,7 +1648,7 @@ SpcMac::BackoffTimeout ()
 	    }
 	  else
 	    {
-	      if (m_rtsSendThreshold <= m_currentPacket1->GetSize ())
+	      if (m_rtsSendThreshold <= GetDataFrameSize (SpcMacHeader::FIRST))
 		{
 		  SendRts ();
 		}
@@ -1186,7 +1667,7 @@ SpcMac::BackoffTimeout ()
 	  else
 	    {
 
-	      if (m_rtsSendThreshold <= m_currentPacket2->GetSize ())
+	      if (m_rtsSendThreshold <= GetDataFrameSize (SpcMacHeader::SECOND))
 		{
 		  SendRts ();
 		}
@@ -34,6 +34,13 @@
 #include "spc-net-device.h"
 #include "node-information-table.h"
 #include "packet-info.h"
+#include "spc-capacity.h"
+#include "spc-power-allocation-table.h"
+#include <vector>
+#include <map>
+#include <list>
+#include <deque>
+#include <utility>
 
 #include "ns3/udp-header.h"
 #include "ns3/ipv4-header.h"
@@ -80,18 +87,40 @@ public:
     uint32_t num2;
   };
 
+  /// Search used by CalculatePowerTimeRate for the power split
+  enum PowerSolver
+  {
+    POWER_SWEEP,
+    POWER_BISECTION,
+    POWER_TABLE
+  };
+
   static TypeId GetTypeId (void);
 
   int64_t AssignStreams (int64_t stream);
 
   Mac48Address GetAddress ();
   double GetNoiseFloor (uint32_t bandwidth) const;
+  void SetCapacityMode (SpcCapacity::Log2Mode mode);
+  SpcCapacity::Log2Mode GetCapacityMode () const;
+  /// Setters of the inputs of the pairing decisions flush the pairing cache
+  void SetPowerSolver (PowerSolver solver);
+  PowerSolver GetPowerSolver () const;
+  void SetPowerPrecision (double precision);
+  double GetPowerPrecision () const;
+  void SetPowerTableFile (std::string fileName);
+  std::string GetPowerTableFile () const;
+  void SetPairingCacheResolution (double resolutionDb);
+  double GetPairingCacheResolution () const;
+  /// Number of pairing decisions held by the cache
+  uint32_t GetPairingCacheEntries () const;
   Ptr<SpcPhy> GetPhy ();
+  Ptr<SpcMacQueue> GetQueue ();
   void SetAddress (Mac48Address);
   void SetNetDevice (Ptr<SpcNetDevice> device);
 
-  void ReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum);
-  void ReceiveError (Ptr<Packet> packet);
+  void ReceiveOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes);
+  void ReceiveError (Ptr<const Packet> packet);
 
   void NotifyMaybeCcaBusyStartNow (Time duration);
   void NotifyTxStartNow (Time duration);
@@ -112,8 +141,34 @@ public:
   void SetNav (Time duration);
 
   struct PowerTimeRate CalculatePowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2, uint32_t bandwidth, bool *isFar);
+  /**
+   * Power split of a superposed frame by a sweep in steps of 0.01, or by
+   * bisection on the split where both layers take equally long: the
+   * airtime of layer 1 falls and that of layer 2 rises with its power.
+   * noiseFloor is GetNoiseFloor (bandwidth).
+   */
+  struct PowerTimeRate SweepPowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+                                           uint32_t bandwidth, double noiseFloor, bool isFar);
+  struct PowerTimeRate BisectPowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+                                            uint32_t bandwidth, double noiseFloor, bool isFar);
+  /// Power split read from the SpcPowerAllocationTable, by bisection outside its grid
+  struct PowerTimeRate TablePowerTimeRate (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+                                           uint32_t bandwidth, double noiseFloor, bool isFar);
+  /// Airtime of each layer when layer 1 gets the given share of the power
+  void GetLayerTimes (double power, double passLoss1, double passLoss2, uint32_t size1, uint32_t size2,
+                      uint32_t bandwidth, double noiseFloor, bool isFar, double *time1, double *time2) const;
   struct TimeRate CalculateTimeRate (double passLoss, uint32_t size, uint32_t bandwidth);
   TimeNum1Num2 GetWaitTimeForBuffer (void);
+  /// Numbers of packets of each layer which send the frame soonest
+  void SearchPacketNums (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2, TimeNum1Num2 *tnn);
+  /**
+   * SearchPacketNums through the pairing cache.  With the cache enabled
+   * the path losses are first rounded to PairingCacheResolution, so a
+   * decision does not depend on whether it was cached.
+   */
+  void GetPacketNums (double passLoss1, double passLoss2, uint32_t size1, uint32_t size2, TimeNum1Num2 *tnn);
+  /// Size of a superposed data frame of num packets of the given size, with its header and FCS
+  uint32_t GetSpcFrameSize (uint32_t size, uint32_t num) const;
   void SetState (void);
 
   void SendRts ();
@@ -124,9 +179,36 @@ public:
   void SendCtsSpcAfterRtsSpc (Mac48Address source, double rssi);
   void SendSpcDataAfterCtsSpc ();
 
-  void SendAckAfterData (Mac48Address source, uint8_t spcNum);
+  void SendAckAfterData (Mac48Address source, uint8_t spcNum, uint16_t bitmap);
   void SendUnicastData ();
   void SendUnicastDataNoAck ();
+  /**
+   * Body of the data frame of layer spcNum: the current packet alone, or
+   * an aggregate of it and the packets in m_aggregate1 or m_aggregate2
+   */
+  Ptr<Packet> CreateFrameBody (uint8_t spcNum);
+  /// Aggregate body of current followed by the packets of aggregate
+  Ptr<Packet> CreateFrameBody (Ptr<const Packet> current, const std::list<Ptr<const Packet> > &aggregate) const;
+  /**
+   * Subframe bounds of the body of layer spcNum for the preamble: the
+   * byte offset of the first subframe and the end of each subframe,
+   * empty for a frame of a single packet
+   */
+  SpcSubframeBounds GetSubframeBounds (uint8_t spcNum) const;
+  SpcSubframeBounds GetSubframeBounds (Ptr<const Packet> current, const std::list<Ptr<const Packet> > &aggregate) const;
+  /// Size of the data frame of layer spcNum, with its header and FCS
+  uint32_t GetDataFrameSize (uint8_t spcNum) const;
+  /**
+   * Pass the body of a data frame up, one subframe at a time if aggregate,
+   * and return the block-ack bitmap of the subframes passed up.  Only the
+   * subframes set in the PHY bitmap received are passed up.
+   */
+  uint16_t ForwardUp (Ptr<Packet> body, bool aggregate, Mac48Address to, Mac48Address from, uint16_t received);
+  /// Queue again the subframes of layer spcNum missing from an ACK bitmap
+  void RequeueLost (uint8_t spcNum, uint16_t bitmap);
+  /// Queue again, with hdr, the subframes of current and aggregate missing from bitmap
+  void RequeueLost (Ptr<const Packet> current, const std::list<Ptr<const Packet> > &aggregate,
+                    const SpcMacHeader &hdr, uint16_t bitmap);
 
   void BackoffGrantStart ();
   void BackoffTimeout ();
@@ -155,6 +237,9 @@ private:
   Ptr<Packet const> m_currentPacket2;
   SpcMacHeader m_currentHdr1;
   SpcMacHeader m_currentHdr2;
+  /// packets sent in the same frame as m_currentPacket1 and m_currentPacket2
+  std::list<Ptr<const Packet> > m_aggregate1;
+  std::list<Ptr<const Packet> > m_aggregate2;
 
   uint32_t m_rtsSendThreshold;
 
@@ -213,6 +298,31 @@ private:
   bool m_unicast;
 
   TimeNum1Num2 m_tnn;
+
+  SpcCapacity m_capacity;
+  /// power split and per-layer SNR of each step of CalculatePowerTimeRate
+  std::vector<double> m_powers;
+  std::vector<double> m_t1;
+  std::vector<double> m_t2;
+  PowerSolver m_powerSolver;
+  double m_powerPrecision;
+  std::string m_powerTableFile;
+  Ptr<SpcPowerAllocationTable> m_powerTable;
+
+  /**
+   * Packet counts chosen by SearchPacketNums, keyed on the path losses in
+   * steps of m_pairingResolutionDb and the packet sizes.  The path losses
+   * come from measured rx powers and take any value, so without rounding
+   * the cache would rarely hit.  When full, the oldest entry is evicted.
+   */
+  typedef std::pair<std::pair<int32_t, int32_t>, std::pair<uint32_t, uint32_t> > PairingKey;
+  typedef std::map<PairingKey, std::pair<uint32_t, uint32_t> > PairingCache;
+  PairingCache m_pairingCache;
+  std::deque<PairingCache::iterator> m_pairingOrder;
+  uint32_t m_pairingCacheSize;
+  double m_pairingResolutionDb;
+  /// Forget the pairing decisions and the power table after a change of their inputs
+  void FlushPairingCache (bool powerTable);
 };
 
 } // namespace ns3
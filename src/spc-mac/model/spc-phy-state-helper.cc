@@ -116,19 +116,19 @@ SpcPhyStateHelper::GetState (void)
 }
 
 void
-SpcPhyStateHelper::EndReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum)
+SpcPhyStateHelper::EndReceiveOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes)
 {
   NS_LOG_FUNCTION (this);
   for (Listeners::const_iterator i = m_listeners.begin (); i != m_listeners.end (); i++)
     {
       NS_LOG_DEBUG ("kita");
-      (*i)->NotifyRxEndOk (packet, rssi, spcNum);
+      (*i)->NotifyRxEndOk (packet, rssi, spcNum, subframes);
     }
   m_rxing = false;
 }
 
 void
-SpcPhyStateHelper::EndReceiveError (Ptr<Packet> packet)
+SpcPhyStateHelper::EndReceiveError (Ptr<const Packet> packet)
 {
   NS_LOG_FUNCTION (this);
   for (Listeners::const_iterator i = m_listeners.begin (); i != m_listeners.end (); i++)
@@ -35,8 +35,9 @@ class SpcPhyListener
 {
 public:
   virtual ~SpcPhyListener ();
-  virtual void NotifyRxEndOk (Ptr<Packet> packet, double rssi, uint8_t spcNum) = 0;
-  virtual void NotifyRxEndError (Ptr<Packet> packet) = 0;
+  /// subframes: bitmap of the subframes of an aggregate received, every bit set otherwise
+  virtual void NotifyRxEndOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes) = 0;
+  virtual void NotifyRxEndError (Ptr<const Packet> packet) = 0;
   virtual void NotifyMaybeCcaBusyStart (Time duration) = 0;
   virtual void NotifyTxStart (Time duration) = 0;
   virtual void NotifyRxStart (Time duration) = 0;
@@ -63,8 +64,8 @@ public:
   void SwitchToTx (Time duration);
   void SwitchToRx (Time duration);
 
-  void EndReceiveOk (Ptr<Packet> packet, double rssi, uint8_t spcNum);
-  void EndReceiveError (Ptr<Packet> packet);
+  void EndReceiveOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes);
+  void EndReceiveError (Ptr<const Packet> packet);
   void RegisterListener (SpcPhyListener *listener);
 
 private:
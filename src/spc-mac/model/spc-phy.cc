@@ -27,6 +27,8 @@
 #include "ns3/log.h"
 #include "ns3/pointer.h"
 #include "ns3/trace-source-accessor.h"
+#include "ns3/uinteger.h"
+#include "ns3/enum.h"
 
 #include "spc-phy.h"
 #include "spc-preamble.h"
@@ -43,10 +45,16 @@ SpcPhy::SpcPhy ()
     m_txGainDb (0),
     m_rxGainDb (0),
     m_txPowerDbm (20),
-    m_endRxEvent ()
+    m_channelNumber (1),
+    m_channelStartingFrequency (2407),
+    m_channelWidth (20),
+    m_backgroundTau (MilliSeconds (10)),
+    m_capacityMode (SpcCapacity::EXACT),
+    m_endRxEvent (),
+    m_niChangesHighWaterMark (0),
+    m_fastPathCount (0)
 {
   NS_LOG_FUNCTION (this);
-  m_channel = CreateObject<SpcChannel>();
   m_state = CreateObject<SpcPhyStateHelper>();
   m_random = CreateObject<UniformRandomVariable> ();
 
@@ -69,8 +77,52 @@ SpcPhy::GetTypeId (void)
 {
   static TypeId tid = TypeId ("ns3::SpcPhy")
     .SetParent<Object> ()
+    .AddAttribute ("ChannelNumber",
+		   "Channel the phy is tuned to. The centre frequency is "
+		   "ChannelStartingFrequency + 5 MHz * ChannelNumber.",
+		   UintegerValue (1),
+		   MakeUintegerAccessor (&SpcPhy::SetChannelNumber,
+					 &SpcPhy::GetChannelNumber),
+		   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("ChannelStartingFrequency",
+		   "Frequency (MHz) of channel 0.",
+		   UintegerValue (2407),
+		   MakeUintegerAccessor (&SpcPhy::m_channelStartingFrequency),
+		   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("ChannelWidth",
+		   "Width (MHz) of the channel. It sets the bandwidth of the frames the phy sends.",
+		   UintegerValue (20),
+		   MakeUintegerAccessor (&SpcPhy::m_channelWidth),
+		   MakeUintegerChecker<uint16_t> ())
+    .AddAttribute ("BackgroundTimeConstant",
+		   "Time constant of the average of the background interference "
+		   "reported by the channel. Must be positive.",
+		   TimeValue (MilliSeconds (10)),
+		   MakeTimeAccessor (&SpcPhy::SetBackgroundTimeConstant,
+				     &SpcPhy::GetBackgroundTimeConstant),
+		   MakeTimeChecker ())
+    .AddAttribute ("CapacityLog2",
+		   "log2 used for the Shannon capacity of received chunks.",
+		   EnumValue (SpcCapacity::EXACT),
+		   MakeEnumAccessor (&SpcPhy::SetCapacityMode,
+				     &SpcPhy::GetCapacityMode),
+		   MakeEnumChecker (SpcCapacity::EXACT, "Exact",
+				    SpcCapacity::FAST, "Fast"))
+    .AddAttribute ("ErrorRateModel",
+		   "Model deciding whether a received chunk can be decoded. "
+		   "Null selects SpcShannonErrorRateModel.",
+		   PointerValue (),
+		   MakePointerAccessor (&SpcPhy::GetErrorRateModel,
+					&SpcPhy::SetErrorRateModel),
+		   MakePointerChecker<SpcErrorRateModel> ())
     .AddTraceSource ("StartTx", "Start transmission",
                      MakeTraceSourceAccessor (&SpcPhy::m_txTrace))
+    .AddTraceSource ("NiChangesHighWaterMark",
+		     "Largest number of NiChanges held by the interference helper",
+		     MakeTraceSourceAccessor (&SpcPhy::m_niChangesHighWaterMark))
+    .AddTraceSource ("FastPathCount",
+		     "Number of receptions decided at one SINR, with no NiChange during the frame",
+		     MakeTraceSourceAccessor (&SpcPhy::m_fastPathCount))
     ;
   return tid;
 }
@@ -81,6 +133,37 @@ SpcPhy::GetRxNoiseFigure () const
   return DbToRatio (m_rxNoiseFigureDb);
 }
 
+void
+SpcPhy::SetChannelNumber (uint16_t channelNumber)
+{
+  NS_LOG_FUNCTION (this << channelNumber);
+  m_channelNumber = channelNumber;
+}
+
+uint16_t
+SpcPhy::GetChannelNumber () const
+{
+  return m_channelNumber;
+}
+
+uint16_t
+SpcPhy::GetFrequency () const
+{
+  return m_channelStartingFrequency + 5 * m_channelNumber;
+}
+
+uint16_t
+SpcPhy::GetChannelWidth () const
+{
+  return m_channelWidth;
+}
+
+uint32_t
+SpcPhy::GetBandwidth () const
+{
+  return m_channelWidth * 1000000;
+}
+
 void
 SpcPhy::SetMobility (Ptr<Object> mobility)
 {
@@ -93,6 +176,13 @@ SpcPhy::SetDevice (Ptr<Object> device)
   m_device = device;
 }
 
+void
+SpcPhy::SetChannel (Ptr<SpcChannel> channel)
+{
+  m_channel = channel;
+  m_channel->Add (this);
+}
+
 Ptr<Object>
 SpcPhy::GetMobility ()
 {
@@ -135,6 +225,9 @@ SpcPhy::StartSend (Ptr<Packet> packet, SpcPreamble preamble)
       m_interference.NotifyRxEnd ();
     }
   m_txTrace (packet);
+  preamble.SetChannelNumber (m_channelNumber);
+  preamble.SetFrequency (GetFrequency ());
+  preamble.SetBandwidth (GetBandwidth ());
   Time txDuration = Seconds((double)packet->GetSize () / preamble.GetRate ()) + preamble.GetDuration ();
   m_state->SwitchToTx (txDuration);
   m_channel->Send (packet, preamble, m_txPowerDbm + m_txGainDb, this);
@@ -150,19 +243,29 @@ SpcPhy::StartSend (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preambl
       m_interference.NotifyRxEnd ();
     }
   //  m_txTrace (packet);
+  preamble.SetChannelNumber (m_channelNumber);
+  preamble.SetFrequency (GetFrequency ());
+  preamble.SetBandwidth (GetBandwidth ());
   Time txDuration = Seconds((double)preamble.GetSymbols () / preamble.GetRate ()) + preamble.GetDuration ();
   m_state->SwitchToTx (txDuration);
   m_channel->Send (packet1, packet2, preamble, m_txPowerDbm + m_txGainDb, this);
 }
 
 void
-SpcPhy::StartReceive (Ptr<Packet> packet, SpcPreamble preamble, double rxPowerDbm)
+SpcPhy::StartReceive (Ptr<const Packet> packet, SpcPreamble preamble, double rxPowerDbm)
 {
   NS_LOG_FUNCTION (this << rxPowerDbm + m_rxGainDb);
   double rxPowerW = DbmToW (rxPowerDbm + m_rxGainDb);
   Time rxDuration = Seconds((double)packet->GetSize () / preamble.GetRate ()) + preamble.GetDuration ();
   Ptr<SpcInterferenceHelper::Event> event;
   event = m_interference.Add (packet->GetSize (), rxDuration, rxPowerW, preamble);
+  m_niChangesHighWaterMark = m_interference.GetNiChangesHighWaterMark ();
+  if (preamble.GetFrequency () != GetFrequency ())
+    {
+      // leakage from another channel: only interference
+      NS_LOG_DEBUG ("Can not receive because frame is on " << preamble.GetFrequency () << " MHz");
+      goto maybeCcaBusy;
+    }
   switch (m_state->GetState ())
     {
     case SpcPhyState::RX:
@@ -203,13 +306,20 @@ maybeCcaBusy:
 }
 
 void
-SpcPhy::StartReceive (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preamble, double rxPowerDbm)
+SpcPhy::StartReceive (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble, double rxPowerDbm)
 {
   NS_LOG_FUNCTION (this << rxPowerDbm + m_rxGainDb);
   double rxPowerW = DbmToW (rxPowerDbm + m_rxGainDb);
   Time rxDuration = Seconds((double)preamble.GetSymbols () / preamble.GetRate ()) + preamble.GetDuration ();
   Ptr<SpcInterferenceHelper::Event> event;
   event = m_interference.Add (preamble.GetSymbols (), rxDuration, rxPowerW, preamble);
+  m_niChangesHighWaterMark = m_interference.GetNiChangesHighWaterMark ();
+  if (preamble.GetFrequency () != GetFrequency ())
+    {
+      // leakage from another channel: only interference
+      NS_LOG_DEBUG ("Can not receive because frame is on " << preamble.GetFrequency () << " MHz");
+      goto maybeCcaBusy;
+    }
   switch (m_state->GetState ())
     {
     case SpcPhyState::RX:
@@ -251,7 +361,7 @@ maybeCcaBusy:
 }
 
 void
-SpcPhy::EndReceive (Ptr<Packet> packet,  Ptr<SpcInterferenceHelper::Event> event)
+SpcPhy::EndReceive (Ptr<const Packet> packet,  Ptr<SpcInterferenceHelper::Event> event)
 {
   NS_LOG_FUNCTION (this << packet);
   NS_ASSERT (event->GetEndTime () == Simulator::Now ());
@@ -259,6 +369,7 @@ SpcPhy::EndReceive (Ptr<Packet> packet,  Ptr<SpcInterferenceHelper::Event> event
   struct SpcInterferenceHelper::SnrPer snrPer;
   snrPer = m_interference.CalculateSnrPer (event);
   m_interference.NotifyRxEnd ();
+  m_fastPathCount = m_interference.GetFastPathCount ();
 
   NS_LOG_DEBUG ("rate="   << (event->GetPreamble ().GetRate ()) <<
                 ", snr="  << snrPer.snr <<
@@ -268,7 +379,7 @@ SpcPhy::EndReceive (Ptr<Packet> packet,  Ptr<SpcInterferenceHelper::Event> event
 
   if (m_random->GetValue () > snrPer.per)
     {
-      m_state->EndReceiveOk (packet, event->GetRxPowerW (), SpcMacHeader::FIRST);
+      m_state->EndReceiveOk (packet, event->GetRxPowerW (), SpcMacHeader::FIRST, DrawSubframes (snrPer.subframePsr, snrPer.nSubframes));
     }
   else
     {
@@ -277,7 +388,7 @@ SpcPhy::EndReceive (Ptr<Packet> packet,  Ptr<SpcInterferenceHelper::Event> event
 }
 
 void
-SpcPhy::EndReceive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, Ptr<SpcInterferenceHelper::Event> event)
+SpcPhy::EndReceive2 (Ptr<const Packet> packet1, Ptr<const Packet> packet2, Ptr<SpcInterferenceHelper::Event> event)
 {
   NS_LOG_FUNCTION (this << packet1 << packet2);
   NS_ASSERT (event->GetEndTime () == Simulator::Now ());
@@ -285,14 +396,17 @@ SpcPhy::EndReceive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, Ptr<SpcInterferen
   struct SpcInterferenceHelper::SnrPer2 snrPer2;
   snrPer2 = m_interference.CalculateSnrPer2 (event);
   m_interference.NotifyRxEnd ();
+  m_fastPathCount = m_interference.GetFastPathCount ();
 
   NS_LOG_DEBUG ("rate=" << (event->GetPreamble ().GetRate ()) <<
                 ", snr1=" << snrPer2.snr1 << ", per1=" << snrPer2.per1 <<
                 ", snr2=" << snrPer2.snr2 << ", per2=" << snrPer2.per2);
 
+  // one draw per layer; the PER of an aggregate layer leaves out its
+  // subframes, drawn one by one
   if (m_random->GetValue () > snrPer2.per1)
     {
-      m_state->EndReceiveOk (packet1, 0, SpcMacHeader::FIRST);
+      m_state->EndReceiveOk (packet1, 0, SpcMacHeader::FIRST, DrawSubframes (snrPer2.subframePsr1, snrPer2.nSubframes1));
     }
   else
     {
@@ -301,7 +415,7 @@ SpcPhy::EndReceive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, Ptr<SpcInterferen
 
   if (m_random->GetValue () > snrPer2.per2)
     {
-      m_state->EndReceiveOk (packet2, 0, SpcMacHeader::SECOND);
+      m_state->EndReceiveOk (packet2, 0, SpcMacHeader::SECOND, DrawSubframes (snrPer2.subframePsr2, snrPer2.nSubframes2));
     }
   else
     {
@@ -309,6 +423,68 @@ SpcPhy::EndReceive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, Ptr<SpcInterferen
     }
 }
 
+uint16_t
+SpcPhy::DrawSubframes (const double *subframePsr, uint32_t nSubframes)
+{
+  uint16_t subframes = 0xffff;
+  for (uint32_t i = 0; i < nSubframes; i++)
+    {
+      if (m_random->GetValue () >= subframePsr[i])
+	{
+	  NS_LOG_DEBUG ("subframe " << i << " lost, psr=" << subframePsr[i]);
+	  subframes &= ~(1 << i);
+	}
+    }
+  return subframes;
+}
+
+void
+SpcPhy::AddBackgroundInterference (double rxPowerDbm, Time start, Time duration)
+{
+  NS_LOG_FUNCTION (this << rxPowerDbm + m_rxGainDb << start << duration);
+  m_interference.AddBackground (DbmToW (rxPowerDbm + m_rxGainDb), start, duration);
+}
+
+void
+SpcPhy::SetBackgroundTimeConstant (Time tau)
+{
+  // the average divides by tau
+  NS_ABORT_MSG_IF (!tau.IsStrictlyPositive (), "BackgroundTimeConstant must be positive, got " << tau);
+  m_backgroundTau = tau;
+  m_interference.SetBackgroundTimeConstant (tau);
+}
+
+Time
+SpcPhy::GetBackgroundTimeConstant () const
+{
+  return m_backgroundTau;
+}
+
+void
+SpcPhy::SetCapacityMode (SpcCapacity::Log2Mode mode)
+{
+  m_capacityMode = mode;
+  m_interference.SetCapacityMode (mode);
+}
+
+SpcCapacity::Log2Mode
+SpcPhy::GetCapacityMode () const
+{
+  return m_capacityMode;
+}
+
+void
+SpcPhy::SetErrorRateModel (Ptr<SpcErrorRateModel> rate)
+{
+  m_interference.SetErrorRateModel (rate);
+}
+
+Ptr<SpcErrorRateModel>
+SpcPhy::GetErrorRateModel () const
+{
+  return m_interference.GetErrorRateModel ();
+}
+
 double
 SpcPhy::DbToRatio (double dB) const
 {
@@ -31,6 +31,7 @@
 #include "ns3/ptr.h"
 #include "ns3/mac48-address.h"
 #include "ns3/traced-callback.h"
+#include "ns3/traced-value.h"
 #include "ns3/random-variable-stream.h"
 #include "spc-random-stream.h"
 #include "spc-channel.h"
@@ -39,6 +40,8 @@
 #include "spc-phy-state-helper.h"
 #include "spc-preamble.h"
 #include "spc-interference-helper.h"
+#include "spc-capacity.h"
+#include "spc-error-rate-model.h"
 
 namespace ns3 {
 
@@ -64,19 +67,36 @@ public:
 
   void SetMobility (Ptr<Object> mobility);
   void SetDevice (Ptr<Object> device);
+  void SetChannel (Ptr<SpcChannel> channel);
   Ptr<Object> GetMobility ();
   Ptr<SpcPhyStateHelper> GetPhyStateHelper () const;
   Ptr<SpcChannel> GetChannel () const;
   Ptr<Object> GetDevice () const;
   double GetRxNoiseFigure () const;
+  void SetChannelNumber (uint16_t channelNumber);
+  uint16_t GetChannelNumber () const;
+  /// centre frequency (MHz) of the current channel
+  uint16_t GetFrequency () const;
+  uint16_t GetChannelWidth () const;
+  /// bandwidth (Hz) of the channel, stamped on every preamble sent
+  uint32_t GetBandwidth () const;
   int64_t AssignStreams (int64_t stream);
 
   void StartSend (Ptr<Packet> pacekt, SpcPreamble preamble);
   void StartSend (Ptr<Packet> pacekt1, Ptr<Packet> pacekt2, SpcPreamble preamble);
-  void StartReceive (Ptr<Packet> packet, SpcPreamble preamble, double rxPowerDbm);
-  void StartReceive (Ptr<Packet> packet1, Ptr<Packet> packet2, SpcPreamble preamble, double rxPowerDbm);
-  void EndReceive (Ptr<Packet> packet, Ptr<SpcInterferenceHelper::Event> event);
-  void EndReceive2 (Ptr<Packet> packet1, Ptr<Packet> packet2, Ptr<SpcInterferenceHelper::Event> event);
+  void StartReceive (Ptr<const Packet> packet, SpcPreamble preamble, double rxPowerDbm);
+  void StartReceive (Ptr<const Packet> packet1, Ptr<const Packet> packet2, SpcPreamble preamble, double rxPowerDbm);
+  void EndReceive (Ptr<const Packet> packet, Ptr<SpcInterferenceHelper::Event> event);
+  void EndReceive2 (Ptr<const Packet> packet1, Ptr<const Packet> packet2, Ptr<SpcInterferenceHelper::Event> event);
+  /// Account a frame too weak to be tracked individually as background noise,
+  /// from its arrival at \p start on
+  void AddBackgroundInterference (double rxPowerDbm, Time start, Time duration);
+  void SetBackgroundTimeConstant (Time tau);
+  Time GetBackgroundTimeConstant () const;
+  void SetCapacityMode (SpcCapacity::Log2Mode mode);
+  SpcCapacity::Log2Mode GetCapacityMode () const;
+  void SetErrorRateModel (Ptr<SpcErrorRateModel> rate);
+  Ptr<SpcErrorRateModel> GetErrorRateModel () const;
   double DbToRatio (double dB) const;
   double DbmToW (double dBm) const;
   double RatioToDb (double ratio) const;
@@ -84,6 +104,9 @@ public:
 protected:
   virtual void DoDispose (void);
 private:
+  /// One draw per subframe of an aggregate: the bitmap of the subframes received
+  uint16_t DrawSubframes (const double *subframePsr, uint32_t nSubframes);
+
   Ptr<SpcChannel> m_channel;
   Ptr<Object> m_mobility;
   Ptr<SpcPhyStateHelper> m_state;
@@ -99,8 +122,16 @@ private:
   double m_txPowerDbm;
   double m_rxNoiseFigureDb;
 
+  uint16_t m_channelNumber;
+  uint16_t m_channelStartingFrequency;
+  uint16_t m_channelWidth;
+  Time m_backgroundTau;
+  SpcCapacity::Log2Mode m_capacityMode;
+
   EventId m_endRxEvent;
   TracedCallback<Ptr<Packet> > m_txTrace;
+  TracedValue<uint32_t> m_niChangesHighWaterMark;
+  TracedValue<uint64_t> m_fastPathCount;
 };
 
 } // namespace ns3
@@ -0,0 +1,321 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#include "spc-power-allocation-table.h"
+#include "ns3/log.h"
+#include <map>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+NS_LOG_COMPONENT_DEFINE ("SpcPowerAllocationTable");
+
+namespace ns3 {
+
+namespace {
+
+const double SNR_MIN_DB = -5.0;
+const double SNR_STEP_DB = 1.0;
+const uint32_t SNR_POINTS = 51;
+const double RATIO_MIN = -4.0;
+const double RATIO_STEP = 0.25;
+const uint32_t RATIO_POINTS = 33;
+const uint32_t COUNT = 2 * SNR_POINTS * SNR_POINTS * RATIO_POINTS;
+/// same range and precision as SpcMac::BisectPowerTimeRate
+const double POWER_MIN = 0.1;
+const double POWER_PRECISION = 1e-6;
+
+/// Start of the file; a file whose header differs is built again
+struct FileHeader
+{
+  char magic[8];
+  uint32_t mode;
+  uint32_t snrPoints;
+  uint32_t ratioPoints;
+  uint32_t reserved;
+  double snrMinDb;
+  double snrStepDb;
+  double ratioMin;
+  double ratioStep;
+};
+
+void
+FillHeader (FileHeader *header, SpcCapacity::Log2Mode mode)
+{
+  std::memset (header, 0, sizeof (FileHeader));
+  std::memcpy (header->magic, "SPCPAT1", 8);
+  header->mode = mode;
+  header->snrPoints = SNR_POINTS;
+  header->ratioPoints = RATIO_POINTS;
+  header->snrMinDb = SNR_MIN_DB;
+  header->snrStepDb = SNR_STEP_DB;
+  header->ratioMin = RATIO_MIN;
+  header->ratioStep = RATIO_STEP;
+}
+
+/// Airtime of each layer, in units of the airtime of layer 2 at efficiency 1
+void
+GetTimes (const SpcCapacity &capacity, double power, double snr1, double snr2, double sizeRatio, bool isFar,
+          double *time1, double *time2)
+{
+  double pow1 = power;
+  double pow2 = 1 - power;
+  double t1, t2;
+  if (isFar)
+    {
+      t1 = (pow1 * snr1) / (pow2 * snr1 + 1);
+      t2 = pow2 * snr2;
+    }
+  else
+    {
+      t1 = pow1 * snr1;
+      t2 = (pow2 * snr2) / (pow1 * snr2 + 1);
+    }
+  *time1 = sizeRatio / capacity.GetEfficiency (t1);
+  *time2 = 1 / capacity.GetEfficiency (t2);
+}
+
+} // anonymous namespace
+
+Ptr<SpcPowerAllocationTable>
+SpcPowerAllocationTable::Get (std::string fileName, SpcCapacity::Log2Mode mode)
+{
+  static std::map<std::pair<std::string, int>, Ptr<SpcPowerAllocationTable> > tables;
+  std::pair<std::string, int> key (fileName, mode);
+  std::map<std::pair<std::string, int>, Ptr<SpcPowerAllocationTable> >::iterator i = tables.find (key);
+  if (i != tables.end ())
+    {
+      return i->second;
+    }
+  Ptr<SpcPowerAllocationTable> table = Create<SpcPowerAllocationTable> (mode);
+  table->Load (fileName);
+  tables[key] = table;
+  return table;
+}
+
+SpcPowerAllocationTable::SpcPowerAllocationTable (SpcCapacity::Log2Mode mode)
+  : m_power (0),
+    m_map (0),
+    m_mapSize (0)
+{
+  m_capacity.SetMode (mode);
+}
+SpcPowerAllocationTable::~SpcPowerAllocationTable ()
+{
+  Unmap ();
+}
+
+void
+SpcPowerAllocationTable::Load (std::string fileName)
+{
+  if (!fileName.empty () && Map (fileName))
+    {
+      NS_LOG_DEBUG ("mapped power allocation table " << fileName);
+      return;
+    }
+  Build ();
+  if (!fileName.empty ())
+    {
+      Save (fileName);
+    }
+}
+
+void
+SpcPowerAllocationTable::Build (void)
+{
+  Unmap ();
+  m_built.resize (COUNT);
+  for (uint32_t far = 0; far < 2; far++)
+    {
+      for (uint32_t i = 0; i < SNR_POINTS; i++)
+        {
+          double snr1 = std::pow (10.0, (SNR_MIN_DB + i * SNR_STEP_DB) / 10);
+          for (uint32_t j = 0; j < SNR_POINTS; j++)
+            {
+              double snr2 = std::pow (10.0, (SNR_MIN_DB + j * SNR_STEP_DB) / 10);
+              for (uint32_t k = 0; k < RATIO_POINTS; k++)
+                {
+                  double sizeRatio = std::pow (2.0, RATIO_MIN + k * RATIO_STEP);
+                  m_built[GetIndex (far, i, j, k)] = Solve (m_capacity, snr1, snr2, sizeRatio, far);
+                }
+            }
+        }
+    }
+  m_power = &m_built[0];
+}
+
+bool
+SpcPowerAllocationTable::GetPower (double snr1, double snr2, uint32_t size1, uint32_t size2, bool isFar, double *power) const
+{
+  if (snr1 <= 0 || snr2 <= 0 || size1 == 0 || size2 == 0)
+    {
+      return false;
+    }
+  double x = (10 * std::log10 (snr1) - SNR_MIN_DB) / SNR_STEP_DB;
+  double y = (10 * std::log10 (snr2) - SNR_MIN_DB) / SNR_STEP_DB;
+  double z = (std::log (double (size1) / size2) / std::log (2.0) - RATIO_MIN) / RATIO_STEP;
+  if (!(x >= 0 && x <= SNR_POINTS - 1 &&
+        y >= 0 && y <= SNR_POINTS - 1 &&
+        z >= 0 && z <= RATIO_POINTS - 1))
+    {
+      return false;
+    }
+  uint32_t i = std::min ((uint32_t)x, SNR_POINTS - 2);
+  uint32_t j = std::min ((uint32_t)y, SNR_POINTS - 2);
+  uint32_t k = std::min ((uint32_t)z, RATIO_POINTS - 2);
+  double fx = x - i;
+  double fy = y - j;
+  double fz = z - k;
+  double value = 0;
+  for (uint32_t c = 0; c < 8; c++)
+    {
+      uint32_t di = c & 1;
+      uint32_t dj = (c >> 1) & 1;
+      uint32_t dk = (c >> 2) & 1;
+      double weight = (di ? fx : 1 - fx) * (dj ? fy : 1 - fy) * (dk ? fz : 1 - fz);
+      value += weight * m_power[GetIndex (isFar, i + di, j + dj, k + dk)];
+    }
+  *power = value;
+  return true;
+}
+
+double
+SpcPowerAllocationTable::Solve (const SpcCapacity &capacity, double snr1, double snr2, double sizeRatio, bool isFar)
+{
+  double low = POWER_MIN;
+  double high = 1.0;
+  double time1, time2;
+  GetTimes (capacity, low, snr1, snr2, sizeRatio, isFar, &time1, &time2);
+  if (time1 <= time2)
+    {
+      return low;
+    }
+  while (high - low > POWER_PRECISION)
+    {
+      double middle = (low + high) / 2;
+      GetTimes (capacity, middle, snr1, snr2, sizeRatio, isFar, &time1, &time2);
+      if (time1 > time2)
+        {
+          low = middle;
+        }
+      else
+        {
+          high = middle;
+        }
+    }
+  double lowTime1, lowTime2, highTime1, highTime2;
+  GetTimes (capacity, low, snr1, snr2, sizeRatio, isFar, &lowTime1, &lowTime2);
+  GetTimes (capacity, high, snr1, snr2, sizeRatio, isFar, &highTime1, &highTime2);
+  if (std::max (highTime1, highTime2) < std::max (lowTime1, lowTime2))
+    {
+      return high;
+    }
+  return low;
+}
+
+bool
+SpcPowerAllocationTable::Map (std::string fileName)
+{
+  size_t size = sizeof (FileHeader) + COUNT * sizeof (float);
+  int fd = open (fileName.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (size_t)st.st_size != size)
+    {
+      close (fd);
+      return false;
+    }
+  void *map = mmap (0, size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    {
+      return false;
+    }
+  FileHeader expected;
+  FillHeader (&expected, m_capacity.GetMode ());
+  if (std::memcmp (map, &expected, sizeof (FileHeader)) != 0)
+    {
+      munmap (map, size);
+      return false;
+    }
+  Unmap ();
+  m_built.clear ();
+  m_map = map;
+  m_mapSize = size;
+  m_power = reinterpret_cast<const float *> (static_cast<const char *> (map) + sizeof (FileHeader));
+  return true;
+}
+
+void
+SpcPowerAllocationTable::Unmap (void)
+{
+  if (m_map != 0)
+    {
+      munmap (m_map, m_mapSize);
+      m_map = 0;
+      m_mapSize = 0;
+      m_power = 0;
+    }
+}
+
+void
+SpcPowerAllocationTable::Save (std::string fileName) const
+{
+  // write a copy and rename it, so a concurrent run never maps half a
+  // file; the copy has a unique name so concurrent runs never share it
+  std::vector<char> temp (fileName.begin (), fileName.end ());
+  const char suffix[] = ".XXXXXX";
+  temp.insert (temp.end (), suffix, suffix + sizeof (suffix));
+  int fd = mkstemp (&temp[0]);
+  if (fd < 0)
+    {
+      NS_LOG_WARN ("Can not save power allocation table to " << fileName);
+      return;
+    }
+  FileHeader header;
+  FillHeader (&header, m_capacity.GetMode ());
+  bool ok = fchmod (fd, 0644) == 0
+    && write (fd, &header, sizeof (FileHeader)) == (ssize_t)sizeof (FileHeader)
+    && write (fd, m_power, COUNT * sizeof (float)) == (ssize_t)(COUNT * sizeof (float));
+  ok = close (fd) == 0 && ok;
+  if (!ok || std::rename (&temp[0], fileName.c_str ()) != 0)
+    {
+      NS_LOG_WARN ("Can not save power allocation table to " << fileName);
+      std::remove (&temp[0]);
+    }
+}
+
+uint32_t
+SpcPowerAllocationTable::GetIndex (bool isFar, uint32_t i, uint32_t j, uint32_t k) const
+{
+  return ((isFar * SNR_POINTS + i) * SNR_POINTS + j) * RATIO_POINTS + k;
+}
+
+} // namespace ns3
@@ -0,0 +1,87 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#ifndef SPC_POWER_ALLOCATION_TABLE_H
+#define SPC_POWER_ALLOCATION_TABLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "ns3/ptr.h"
+#include "ns3/simple-ref-count.h"
+#include "spc-capacity.h"
+
+namespace ns3 {
+
+/**
+ * Power share of layer 1 of a superposed frame which makes both layers
+ * take equally long, precomputed on a grid of the SNR of each receiver
+ * (-5 to 45 dB in steps of 1 dB) and log2 of the ratio of the sizes of
+ * the layers (-4 to 4 in steps of 0.25), for both orders of decoding.
+ * In these coordinates the split does not depend on the bandwidth, so
+ * one table serves every bandwidth.
+ *
+ * The table may be saved to a file and memory-mapped by later runs
+ * instead of being built again.
+ */
+class SpcPowerAllocationTable : public SimpleRefCount<SpcPowerAllocationTable>
+{
+public:
+  /**
+   * Table shared by every caller with the same file and log2 mode.  An
+   * empty fileName keeps the table in memory only.
+   */
+  static Ptr<SpcPowerAllocationTable> Get (std::string fileName, SpcCapacity::Log2Mode mode);
+
+  SpcPowerAllocationTable (SpcCapacity::Log2Mode mode);
+  ~SpcPowerAllocationTable ();
+
+  /// Map the table from fileName, or build it and save it there
+  void Load (std::string fileName);
+  void Build (void);
+  /**
+   * Power share of layer 1, interpolated from the grid.  Returns false
+   * when the SNRs or the size ratio are outside the grid.
+   */
+  bool GetPower (double snr1, double snr2, uint32_t size1, uint32_t size2, bool isFar, double *power) const;
+  /**
+   * Power share of layer 1 in [0.1, 1) at which a layer 1 sizeRatio
+   * times as large as layer 2 takes as long as layer 2, by bisection.
+   */
+  static double Solve (const SpcCapacity &capacity, double snr1, double snr2, double sizeRatio, bool isFar);
+
+private:
+  bool Map (std::string fileName);
+  void Unmap (void);
+  void Save (std::string fileName) const;
+  uint32_t GetIndex (bool isFar, uint32_t i, uint32_t j, uint32_t k) const;
+
+  SpcCapacity m_capacity;
+  std::vector<float> m_built;
+  /// the grid, in m_built or in the mapped file
+  const float *m_power;
+  void *m_map;
+  size_t m_mapSize;
+};
+
+} // namespace ns3
+
+#endif /* SPC_POWER_ALLOCATION_TABLE_H */
@@ -25,10 +25,49 @@ NS_LOG_COMPONENT_DEFINE ("SpcPreamble");
 
 namespace ns3 {
 
+SpcSubframeBounds::SpcSubframeBounds ()
+  : m_n (0)
+{
+}
+
+void
+SpcSubframeBounds::Clear (void)
+{
+  m_n = 0;
+}
+
+void
+SpcSubframeBounds::Add (uint32_t bound)
+{
+  NS_ASSERT_MSG (m_n <= SPC_MAC_MAX_SUBFRAMES, "more than " << SPC_MAC_MAX_SUBFRAMES << " subframes");
+  m_bounds[m_n++] = bound;
+}
+
+bool
+SpcSubframeBounds::IsEmpty (void) const
+{
+  return m_n == 0;
+}
+
+uint32_t
+SpcSubframeBounds::GetN (void) const
+{
+  return m_n;
+}
+
+uint32_t
+SpcSubframeBounds::Get (uint32_t i) const
+{
+  NS_ASSERT (i < m_n);
+  return m_bounds[i];
+}
+
 SpcPreamble::SpcPreamble ()
   : m_rate (6000000 / 8),
     m_bandwidth (20000000),
-    m_duration (MicroSeconds (24))
+    m_duration (MicroSeconds (24)),
+    m_channelNumber (1),
+    m_frequency (2412)
 {
 }
 
@@ -61,6 +100,16 @@ SpcPreamble::SetDuration (Time duration){
   m_duration = duration;
 }
 
+void
+SpcPreamble::SetChannelNumber (uint16_t channelNumber){
+  m_channelNumber = channelNumber;
+}
+
+void
+SpcPreamble::SetFrequency (uint16_t frequency){
+  m_frequency = frequency;
+}
+
 void
 SpcPreamble::SetSymbols (uint32_t length){
   m_symbols = length;
@@ -76,44 +125,74 @@ SpcPreamble::SetFLength (uint32_t length){
   m_fLength = length;
 }
 
+void
+SpcPreamble::SetNSubframes (const SpcSubframeBounds &bounds){
+  m_nSubframes = bounds;
+}
+
+void
+SpcPreamble::SetFSubframes (const SpcSubframeBounds &bounds){
+  m_fSubframes = bounds;
+}
+
 double
-SpcPreamble::GetPower (){
+SpcPreamble::GetPower () const{
   return m_power;
 }
 
 uint32_t
-SpcPreamble::GetRate (){
+SpcPreamble::GetRate () const{
   return m_rate;
 }
 
 bool
-SpcPreamble::GetIsFar (){
+SpcPreamble::GetIsFar () const{
   return m_isFar;
 }
 
 uint32_t
-SpcPreamble::GetBandwidth (){
+SpcPreamble::GetBandwidth () const{
   return m_bandwidth;
 }
 
 Time
-SpcPreamble::GetDuration (){
+SpcPreamble::GetDuration () const{
   return m_duration;
 }
 
 uint32_t
-SpcPreamble::GetSymbols (){
+SpcPreamble::GetSymbols () const{
   return m_symbols;
 }
 
 uint32_t
-SpcPreamble::GetNLength (){
+SpcPreamble::GetNLength () const{
   return m_nLength;
 }
 
 uint32_t
-SpcPreamble::GetFLength (){
+SpcPreamble::GetFLength () const{
   return m_fLength;
 }
 
+uint16_t
+SpcPreamble::GetChannelNumber () const{
+  return m_channelNumber;
+}
+
+uint16_t
+SpcPreamble::GetFrequency () const{
+  return m_frequency;
+}
+
+const SpcSubframeBounds &
+SpcPreamble::GetNSubframes () const{
+  return m_nSubframes;
+}
+
+const SpcSubframeBounds &
+SpcPreamble::GetFSubframes () const{
+  return m_fSubframes;
+}
+
 }
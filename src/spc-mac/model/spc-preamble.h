@@ -23,10 +23,33 @@
 
 #include <stdint.h>
 #include "ns3/nstime.h"
+#include "spc-mac-header.h"
 
 
 namespace ns3 {
 
+/**
+ * Subframe bounds of an aggregate layer, as byte offsets in the frame
+ * body: the start of the first subframe and the end of each subframe.
+ * Held in place, for at most SPC_MAC_MAX_SUBFRAMES subframes, so that
+ * copying a preamble allocates nothing.  Empty for a frame of a single
+ * packet.
+ */
+class SpcSubframeBounds
+{
+public:
+  SpcSubframeBounds ();
+  void Clear (void);
+  void Add (uint32_t bound);
+  bool IsEmpty (void) const;
+  /// number of bounds, one more than the number of subframes
+  uint32_t GetN (void) const;
+  uint32_t Get (uint32_t i) const;
+private:
+  uint32_t m_n;
+  uint32_t m_bounds[SPC_MAC_MAX_SUBFRAMES + 1];
+};
+
 class SpcPreamble
 {
 public:
@@ -40,14 +63,23 @@ public:
   void SetNLength (uint32_t length);
   void SetFLength (uint32_t length);
   void SetDuration (Time duration);
-  bool GetIsFar ();
-  uint32_t GetRate ();
-  double GetPower ();
-  uint32_t GetBandwidth ();
-  Time GetDuration ();
-  uint32_t GetSymbols ();
-  uint32_t GetNLength ();
-  uint32_t GetFLength ();
+  void SetChannelNumber (uint16_t channelNumber);
+  void SetFrequency (uint16_t frequency);
+  /// Subframe bounds of an aggregate in layer 1 (N) or 2 (F)
+  void SetNSubframes (const SpcSubframeBounds &bounds);
+  void SetFSubframes (const SpcSubframeBounds &bounds);
+  bool GetIsFar () const;
+  uint32_t GetRate () const;
+  double GetPower () const;
+  uint32_t GetBandwidth () const;
+  Time GetDuration () const;
+  uint32_t GetSymbols () const;
+  uint32_t GetNLength () const;
+  uint32_t GetFLength () const;
+  uint16_t GetChannelNumber () const;
+  uint16_t GetFrequency () const;
+  const SpcSubframeBounds &GetNSubframes () const;
+  const SpcSubframeBounds &GetFSubframes () const;
 private:
   bool m_isFar;
   uint32_t m_rate;
@@ -70,6 +102,12 @@ private:
   uint32_t m_symbols;
   uint32_t m_nLength;
   uint32_t m_fLength;
+  uint16_t m_channelNumber;
+  /// centre frequency of the transmitter (MHz)
+  uint16_t m_frequency;
+  /// subframe bounds of each layer, signalled with the lengths
+  SpcSubframeBounds m_nSubframes;
+  SpcSubframeBounds m_fSubframes;
 };
 }
 
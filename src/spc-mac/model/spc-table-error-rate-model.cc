@@ -0,0 +1,225 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#include "spc-table-error-rate-model.h"
+#include "ns3/log.h"
+#include "ns3/string.h"
+#include "ns3/uinteger.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+NS_LOG_COMPONENT_DEFINE ("SpcTableErrorRateModel");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (SpcTableErrorRateModel);
+
+TypeId
+SpcTableErrorRateModel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::SpcTableErrorRateModel")
+    .SetParent<SpcErrorRateModel> ()
+    .AddConstructor<SpcTableErrorRateModel> ()
+    .AddAttribute ("FileName",
+                   "CSV file of rate,snrDb,bler points.",
+                   StringValue (""),
+                   MakeStringAccessor (&SpcTableErrorRateModel::GetFileName,
+                                       &SpcTableErrorRateModel::SetFileName),
+                   MakeStringChecker ())
+    .AddAttribute ("BlockSize",
+                   "Size (bytes) of the block the BLER of the file refers to.",
+                   UintegerValue (1500),
+                   MakeUintegerAccessor (&SpcTableErrorRateModel::GetBlockSize,
+                                         &SpcTableErrorRateModel::SetBlockSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("Points",
+                   "Number of points of the resampled curves.",
+                   UintegerValue (4096),
+                   MakeUintegerAccessor (&SpcTableErrorRateModel::GetPoints,
+                                         &SpcTableErrorRateModel::SetPoints),
+                   MakeUintegerChecker<uint32_t> (2))
+    ;
+  return tid;
+}
+
+SpcTableErrorRateModel::SpcTableErrorRateModel ()
+  : m_blockSize (1500),
+    m_points (4096),
+    m_minDb (0),
+    m_maxDb (0),
+    m_minEfficiency (0),
+    m_scale (0)
+{
+}
+
+void
+SpcTableErrorRateModel::SetFileName (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+  m_fileName = fileName;
+  m_table.clear ();
+  m_curves.clear ();
+  if (m_fileName.empty ())
+    {
+      return;
+    }
+  std::ifstream file (m_fileName.c_str ());
+  if (!file.good ())
+    {
+      NS_FATAL_ERROR ("Can not open BLER table " << m_fileName);
+    }
+
+  double minDb = std::numeric_limits<double>::max ();
+  double maxDb = -std::numeric_limits<double>::max ();
+  std::string line;
+  while (std::getline (file, line))
+    {
+      if (line.empty () || line[0] == '#')
+        {
+          continue;
+        }
+      std::replace (line.begin (), line.end (), ',', ' ');
+      std::istringstream is (line);
+      uint32_t rate;
+      double snrDb;
+      double bler;
+      if (!(is >> rate >> snrDb >> bler))
+        {
+          NS_FATAL_ERROR ("Malformed line in BLER table " << m_fileName << ": " << line);
+        }
+      m_table[rate].push_back (std::make_pair (snrDb, bler));
+      minDb = std::min (minDb, snrDb);
+      maxDb = std::max (maxDb, snrDb);
+    }
+  if (m_table.empty ())
+    {
+      NS_FATAL_ERROR ("Empty BLER table " << m_fileName);
+    }
+  for (std::map<uint32_t, Points>::iterator it = m_table.begin (); it != m_table.end (); it++)
+    {
+      std::sort (it->second.begin (), it->second.end ());
+    }
+  m_minDb = minDb;
+  m_maxDb = maxDb;
+  Resample ();
+}
+
+std::string
+SpcTableErrorRateModel::GetFileName (void) const
+{
+  return m_fileName;
+}
+
+void
+SpcTableErrorRateModel::SetBlockSize (uint32_t blockSize)
+{
+  m_blockSize = blockSize;
+  Resample ();
+}
+
+uint32_t
+SpcTableErrorRateModel::GetBlockSize (void) const
+{
+  return m_blockSize;
+}
+
+void
+SpcTableErrorRateModel::SetPoints (uint32_t points)
+{
+  m_points = points;
+  Resample ();
+}
+
+uint32_t
+SpcTableErrorRateModel::GetPoints (void) const
+{
+  return m_points;
+}
+
+void
+SpcTableErrorRateModel::Resample (void)
+{
+  m_curves.clear ();
+  if (m_table.empty ())
+    {
+      return;
+    }
+  m_minEfficiency = log2 (1 + std::pow (10.0, m_minDb / 10.0));
+  double maxEfficiency = log2 (1 + std::pow (10.0, m_maxDb / 10.0));
+  m_scale = maxEfficiency > m_minEfficiency ? (m_points - 1) / (maxEfficiency - m_minEfficiency) : 0;
+
+  for (std::map<uint32_t, Points>::const_iterator it = m_table.begin (); it != m_table.end (); it++)
+    {
+      const Points &curve = it->second;
+      std::vector<double> &lnSuccess = m_curves[it->first];
+      lnSuccess.resize (m_points);
+      for (uint32_t k = 0; k < m_points; k++)
+        {
+          double efficiency = m_minEfficiency + (m_scale > 0 ? k / m_scale : 0);
+          double snrDb = 10 * std::log10 (std::pow (2.0, efficiency) - 1);
+          // linear in dB between the points, flat outside them
+          double bler;
+          Points::const_iterator hi = std::lower_bound (curve.begin (), curve.end (),
+                                                        std::make_pair (snrDb, -std::numeric_limits<double>::max ()));
+          if (hi == curve.begin ())
+            {
+              bler = hi->second;
+            }
+          else if (hi == curve.end ())
+            {
+              bler = curve.back ().second;
+            }
+          else
+            {
+              Points::const_iterator lo = hi - 1;
+              double w = (snrDb - lo->first) / (hi->first - lo->first);
+              bler = lo->second + w * (hi->second - lo->second);
+            }
+          bler = std::min (std::max (bler, 0.0), 1.0);
+          lnSuccess[k] = bler >= 1.0 ? -std::numeric_limits<double>::infinity ()
+            : std::log (1 - bler) / m_blockSize;
+        }
+      NS_LOG_DEBUG ("rate=" << it->first << ", " << curve.size () << " points");
+    }
+}
+
+double
+SpcTableErrorRateModel::GetChunkSuccessRate (const SpcPreamble &preamble, double efficiency,
+                                             uint64_t nbytes, Time duration) const
+{
+  NS_ASSERT_MSG (!m_curves.empty (), "No BLER table, set FileName");
+  if (nbytes == 0)
+    {
+      return 1;
+    }
+  Curves::const_iterator it = m_curves.lower_bound (preamble.GetRate ());
+  if (it == m_curves.end ())
+    {
+      it--;
+    }
+  double x = (efficiency - m_minEfficiency) * m_scale + 0.5;
+  uint32_t k = x <= 0 ? 0 : std::min<uint32_t> ((uint32_t)x, m_points - 1);
+  return std::exp (nbytes * it->second[k]);
+}
+
+} // namespace ns3
@@ -0,0 +1,85 @@
+/* -*- Mode:C++; -*- */
+/*
+ * Copyright (c) 2014 Yusuke Sugiyama
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., Saruwatari Lab, Shizuoka University, Japan
+ *
+ * Author: Yusuke Sugiyama <sugiyama@aurum.cs.inf.shizuoka.ac.jp>
+ */
+
+#ifndef SPC_TABLE_ERROR_RATE_MODEL_H
+#define SPC_TABLE_ERROR_RATE_MODEL_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include "spc-error-rate-model.h"
+
+namespace ns3 {
+
+/**
+ * Error rate model driven by measured SNR -> BLER curves.
+ *
+ * The file is CSV, one point per line: "rate,snrDb,bler", where rate is
+ * the rate of SpcPreamble (bytes/s) and bler the error rate of a block
+ * of BlockSize bytes.  Lines starting with '#' are ignored.  The file
+ * is read when FileName is set, and the curves are resampled on a
+ * uniform grid of log2 (1 + SNR) whenever an attribute changes, so a
+ * lookup is one multiply, one index and one exp.
+ * A frame uses the curve of the smallest tabulated rate not below its
+ * own rate, or the fastest curve if there is none.
+ */
+class SpcTableErrorRateModel : public SpcErrorRateModel
+{
+public:
+  static TypeId GetTypeId (void);
+
+  SpcTableErrorRateModel ();
+
+  virtual double GetChunkSuccessRate (const SpcPreamble &preamble, double efficiency,
+                                      uint64_t nbytes, Time duration) const;
+
+  /// Read the points of a file and build the lookup arrays
+  void SetFileName (std::string fileName);
+  std::string GetFileName (void) const;
+  void SetBlockSize (uint32_t blockSize);
+  uint32_t GetBlockSize (void) const;
+  void SetPoints (uint32_t points);
+  uint32_t GetPoints (void) const;
+
+private:
+  /// (snrDb, bler) points of a rate, sorted by SNR
+  typedef std::vector<std::pair<double, double> > Points;
+  typedef std::map<uint32_t, std::vector<double> > Curves;
+
+  /// Build the lookup arrays from the points read
+  void Resample (void);
+
+  std::string m_fileName;
+  uint32_t m_blockSize;
+  uint32_t m_points;
+
+  /// the file as read, per rate
+  std::map<uint32_t, Points> m_table;
+  double m_minDb;
+  double m_maxDb;
+  double m_minEfficiency;
+  double m_scale;
+  /// per rate: ln of the success rate of one byte at each grid point
+  Curves m_curves;
+};
+
+} // namespace ns3
+
+#endif /* SPC_TABLE_ERROR_RATE_MODEL_H */
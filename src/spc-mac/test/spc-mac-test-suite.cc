@@ -2,6 +2,33 @@
 
 // Include a header file from your module to test.
 #include "ns3/spc-mac.h"
+#include "ns3/spc-capacity.h"
+#include "ns3/spc-interference-helper.h"
+#include "ns3/spc-mac-header.h"
+#include "ns3/spc-amsdu-subframe-header.h"
+#include "ns3/spc-mac-queue.h"
+#include "ns3/spc-mac-trailer.h"
+#include "ns3/spc-net-device.h"
+#include "ns3/node-information-table.h"
+#include "ns3/spc-channel.h"
+#include "ns3/spc-phy.h"
+#include "ns3/spc-phy-state-helper.h"
+#include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/enum.h"
+#include "ns3/string.h"
+#include "ns3/node.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/constant-position-mobility-model.h"
+#include "ns3/llc-snap-header.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/udp-header.h"
+#include "ns3/packet-info.h"
+#include <cmath>
+#include <vector>
+#include <deque>
 
 // An essential include is test.h
 #include "ns3/test.h"
@@ -46,10 +73,1296 @@ SpcMacTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+// The fast log2 back-end of SpcCapacity must give the same decoding
+// decisions as libm over the SNR range used by the simulations.
+class SpcCapacityTestCase : public TestCase
+{
+public:
+  SpcCapacityTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// The capacity test of SpcInterferenceHelper::CheckChunkCapacity
+  bool Decode (double efficiency, double seconds, uint32_t rate) const;
+};
+
+SpcCapacityTestCase::SpcCapacityTestCase ()
+  : TestCase ("Fast log2 capacity kernel matches libm from -5 to 40 dB")
+{
+}
+
+bool
+SpcCapacityTestCase::Decode (double efficiency, double seconds, uint32_t rate) const
+{
+  uint64_t nbytes = (uint64_t)(rate * seconds);
+  uint64_t shannonBits = 20000000 * efficiency;
+  uint64_t shannonBytes = shannonBits / 8;
+  shannonBytes = shannonBytes * seconds;
+  return shannonBytes >= nbytes;
+}
+
+void
+SpcCapacityTestCase::DoRun (void)
+{
+  const double tolerance = 1e-8;
+  SpcCapacity exact;
+  SpcCapacity fast;
+  fast.SetMode (SpcCapacity::FAST);
+
+  std::vector<double> snr;
+  for (double db = -5.0; db <= 40.0; db += 0.01)
+    {
+      snr.push_back (std::pow (10.0, db / 10.0));
+    }
+  std::vector<double> batch (snr.size ());
+  fast.GetEfficiency (&snr[0], &batch[0], snr.size ());
+
+  uint32_t rates[] = { 750000, 3000000, 6750000, 15000000 };
+  double seconds[] = { 4e-6, 1e-4, 2e-3 };
+  for (uint32_t i = 0; i < snr.size (); i++)
+    {
+      double e = exact.GetEfficiency (snr[i]);
+      double f = fast.GetEfficiency (snr[i]);
+      NS_TEST_ASSERT_MSG_EQ_TOL (f, e, e * tolerance, "fast log2 error too large at snr=" << snr[i]);
+      NS_TEST_ASSERT_MSG_EQ (batch[i], f, "batch and scalar results differ at snr=" << snr[i]);
+      for (uint32_t r = 0; r < sizeof (rates) / sizeof (rates[0]); r++)
+        {
+          for (uint32_t d = 0; d < sizeof (seconds) / sizeof (seconds[0]); d++)
+            {
+              // a decision may only flip when the exact capacity is
+              // within the tolerance of the number of bytes to send
+              double margin = std::fabs (20000000 * e / 8 * seconds[d] - rates[r] * seconds[d]);
+              if (margin <= 20000000 * e / 8 * seconds[d] * tolerance + 1)
+                {
+                  continue;
+                }
+              NS_TEST_ASSERT_MSG_EQ (Decode (f, seconds[d], rates[r]), Decode (e, seconds[d], rates[r]),
+                                     "decision differs at snr=" << snr[i] << " rate=" << rates[r]);
+            }
+        }
+    }
+}
+
+// A phy on an existing node, sharing its mobility model
+static Ptr<SpcPhy>
+AddPhy (Ptr<SpcChannel> channel, Ptr<Node> node)
+{
+  Ptr<SimpleNetDevice> device = CreateObject<SimpleNetDevice> ();
+  node->AddDevice (device);
+  Ptr<SpcPhy> phy = CreateObject<SpcPhy> ();
+  phy->SetMobility (node);
+  phy->SetDevice (device);
+  phy->SetChannel (channel);
+  return phy;
+}
+
+// A phy on a node of its own at (x, y, z)
+static Ptr<SpcPhy>
+CreatePhy (Ptr<SpcChannel> channel, double x, double y = 0, double z = 0)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (Vector (x, y, z));
+  node->AggregateObject (mobility);
+  return AddPhy (channel, node);
+}
+
+// Time and context of what a phy reports to its listeners
+class SpcRxRecorder : public SpcPhyListener
+{
+public:
+  SpcRxRecorder ()
+    : errors (0)
+  {
+  }
+  virtual void NotifyRxEndOk (Ptr<const Packet> packet, double rssi, uint8_t spcNum, uint16_t subframes)
+  {
+    packets.push_back (packet);
+    subframeBitmaps.push_back (subframes);
+    rssis.push_back (rssi);
+    rxEnds.push_back (Simulator::Now ());
+    rxEndContexts.push_back (Simulator::GetContext ());
+  }
+  virtual void NotifyRxEndError (Ptr<const Packet> packet)
+  {
+    errors++;
+  }
+  virtual void NotifyMaybeCcaBusyStart (Time duration)
+  {
+    ccaBusyEnds.push_back (Simulator::Now () + duration);
+  }
+  virtual void NotifyTxStart (Time duration)
+  {
+  }
+  virtual void NotifyRxStart (Time duration)
+  {
+    rxStarts.push_back (Simulator::Now ());
+    rxStartContexts.push_back (Simulator::GetContext ());
+  }
+
+  std::vector<Time> rxStarts;
+  std::vector<uint32_t> rxStartContexts;
+  std::vector<Time> rxEnds;
+  std::vector<uint32_t> rxEndContexts;
+  std::vector<Time> ccaBusyEnds;
+  std::vector<double> rssis;
+  std::vector<Ptr<const Packet> > packets;
+  std::vector<uint16_t> subframeBitmaps;
+  uint32_t errors;
+};
+
+static void
+SendFrame (Ptr<SpcPhy> phy, uint32_t size)
+{
+  SpcPreamble preamble;
+  phy->StartSend (Create<Packet> (size), preamble);
+}
+
+class SpcFanOutTestCase : public TestCase
+{
+public:
+  SpcFanOutTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcFanOutTestCase::SpcFanOutTestCase ()
+  : TestCase ("Fan-out walks a transmission with one event, receptions run in the context of the receiver")
+{
+}
+
+void
+SpcFanOutTestCase::DoRun (void)
+{
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  channel->SetAttribute ("FanOut", BooleanValue (true));
+  Ptr<SpcPhy> sender = CreatePhy (channel, 0);
+  // three nodes at the same distance from the sender
+  Vector positions[] = { Vector (30, 0, 0), Vector (0, 30, 0), Vector (0, 0, 30) };
+  Ptr<SpcPhy> receivers[3];
+  SpcRxRecorder recorders[3];
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      receivers[i] = CreatePhy (channel, positions[i].x, positions[i].y, positions[i].z);
+      receivers[i]->GetPhyStateHelper ()->RegisterListener (&recorders[i]);
+    }
+  uint32_t senderNode = sender->GetDevice ()->GetObject<NetDevice> ()->GetNode ()->GetId ();
+  Simulator::ScheduleWithContext (senderNode, Seconds (1), &SendFrame, sender, 100);
+  Simulator::Run ();
+
+  SpcPreamble preamble;
+  Time duration = Seconds (100.0 / preamble.GetRate ()) + preamble.GetDuration ();
+  Time arrival = Seconds (1) + Seconds (30 / 299792458.0);
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      uint32_t node = receivers[i]->GetDevice ()->GetObject<NetDevice> ()->GetNode ()->GetId ();
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxStarts.size (), 1, "receiver " << i << " did not receive");
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxEnds.size (), 1, "receiver " << i << " did not decode");
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxStarts[0], arrival, "wrong arrival time at receiver " << i);
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxEnds[0], arrival + duration, "wrong end time at receiver " << i);
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxStartContexts[0], node, "reception outside the receiver context");
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxEndContexts[0], node, "end of reception outside the receiver context");
+    }
+  NS_TEST_ASSERT_MSG_EQ (channel->GetFanOutEvents (), 1, "expected one walker event per transmission");
+  Simulator::Destroy ();
+}
+
+class SpcSharedMobilityTestCase : public TestCase
+{
+public:
+  SpcSharedMobilityTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcSharedMobilityTestCase::SpcSharedMobilityTestCase ()
+  : TestCase ("Every phy of a moving node follows it in the range culling grid")
+{
+}
+
+void
+SpcSharedMobilityTestCase::DoRun (void)
+{
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  channel->SetAttribute ("RangeCulling", BooleanValue (true));
+  Ptr<SpcPhy> sender = CreatePhy (channel, 0);
+  // two phys on one node, out of range until the node moves
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<MobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (Vector (10000, 0, 0));
+  node->AggregateObject (mobility);
+  SpcRxRecorder recorders[2];
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      AddPhy (channel, node)->GetPhyStateHelper ()->RegisterListener (&recorders[i]);
+    }
+  Simulator::Schedule (Seconds (1), &SendFrame, sender, 100);
+  Simulator::Schedule (Seconds (2), &MobilityModel::SetPosition, mobility, Vector (60, 0, 0));
+  Simulator::Schedule (Seconds (3), &SendFrame, sender, 100);
+  Simulator::Run ();
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rxStarts.size (), 1, "phy " << i << " of the node did not move in the grid");
+      NS_TEST_ASSERT_MSG_EQ ((recorders[i].rxStarts[0] > Seconds (3)), true, "phy " << i << " received from out of range");
+    }
+  Simulator::Destroy ();
+}
+
+class SpcSharedLinkCacheTestCase : public TestCase
+{
+public:
+  SpcSharedLinkCacheTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcSharedLinkCacheTestCase::SpcSharedLinkCacheTestCase ()
+  : TestCase ("A move of a node invalidates the cached links of all its phys")
+{
+}
+
+void
+SpcSharedLinkCacheTestCase::DoRun (void)
+{
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  // the entries never expire by themselves
+  channel->SetAttribute ("LinkCache", BooleanValue (true));
+  Ptr<SpcPhy> sender = CreatePhy (channel, 0);
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<MobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (Vector (60, 0, 0));
+  node->AggregateObject (mobility);
+  SpcRxRecorder recorders[2];
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      AddPhy (channel, node)->GetPhyStateHelper ()->RegisterListener (&recorders[i]);
+    }
+  Simulator::Schedule (Seconds (1), &SendFrame, sender, 100);
+  Simulator::Schedule (Seconds (2), &MobilityModel::SetPosition, mobility, Vector (90, 0, 0));
+  Simulator::Schedule (Seconds (3), &SendFrame, sender, 100);
+  Simulator::Run ();
+
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rssis.size (), 2, "phy " << i << " should decode both frames");
+      NS_TEST_ASSERT_MSG_EQ ((recorders[i].rssis[1] < recorders[i].rssis[0]), true,
+                             "phy " << i << " served a stale link after the move");
+    }
+  NS_TEST_ASSERT_MSG_EQ_TOL (recorders[0].rssis[1], recorders[1].rssis[1], recorders[1].rssis[1] * 1e-9,
+                             "the phys of one node see different rx powers");
+  Simulator::Destroy ();
+}
+
+class SpcBatchRxPowerTestCase : public TestCase
+{
+public:
+  SpcBatchRxPowerTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Run (bool batch, std::vector<double> *rssis, std::vector<Time> *arrivals);
+};
+
+SpcBatchRxPowerTestCase::SpcBatchRxPowerTestCase ()
+  : TestCase ("Batched rx power agrees with the per-receiver propagation models")
+{
+}
+
+void
+SpcBatchRxPowerTestCase::Run (bool batch, std::vector<double> *rssis, std::vector<Time> *arrivals)
+{
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  channel->SetAttribute ("BatchRxPower", BooleanValue (batch));
+  Ptr<SpcPhy> sender = CreatePhy (channel, 1.5, -2.0, 0.5);
+  const uint32_t n = 5;
+  double positions[n][3] = { { 4, 0, 0 }, { -7.3, 11.1, 0 }, { 20, 20, 3 }, { 0.5, -35.2, 1.2 }, { 52.7, 0, -4 } };
+  Ptr<SpcPhy> receivers[n];
+  SpcRxRecorder recorders[n];
+  for (uint32_t i = 0; i < n; i++)
+    {
+      receivers[i] = CreatePhy (channel, positions[i][0], positions[i][1], positions[i][2]);
+      receivers[i]->GetPhyStateHelper ()->RegisterListener (&recorders[i]);
+    }
+  Simulator::Schedule (Seconds (1), &SendFrame, sender, 100);
+  Simulator::Run ();
+  for (uint32_t i = 0; i < n; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (recorders[i].rssis.size (), 1, "receiver " << i << " did not decode");
+      rssis->push_back (recorders[i].rssis[0]);
+      arrivals->push_back (recorders[i].rxStarts[0]);
+    }
+  Simulator::Destroy ();
+}
+
+void
+SpcBatchRxPowerTestCase::DoRun (void)
+{
+  std::vector<double> batchRssis, rssis;
+  std::vector<Time> batchArrivals, arrivals;
+  Run (true, &batchRssis, &batchArrivals);
+  Run (false, &rssis, &arrivals);
+  NS_TEST_ASSERT_MSG_EQ (batchRssis.size (), rssis.size (), "not the same receptions");
+  for (uint32_t i = 0; i < rssis.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ_TOL (batchRssis[i] / rssis[i], 1.0, 1e-9, "rx power of receiver " << i);
+      NS_TEST_ASSERT_MSG_EQ_TOL (batchArrivals[i].GetSeconds (), arrivals[i].GetSeconds (), 1e-15,
+                                 "arrival time at receiver " << i);
+    }
+}
+
+class SpcAdjacentChannelTestCase : public TestCase
+{
+public:
+  SpcAdjacentChannelTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Run (double rejectionDb, uint16_t width, SpcRxRecorder *coChannel, SpcRxRecorder *adjacent);
+};
+
+SpcAdjacentChannelTestCase::SpcAdjacentChannelTestCase ()
+  : TestCase ("A frame on an adjacent channel is only interference, after the channel rejection")
+{
+}
+
+void
+SpcAdjacentChannelTestCase::Run (double rejectionDb, uint16_t width, SpcRxRecorder *coChannel, SpcRxRecorder *adjacent)
+{
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  channel->SetAttribute ("AdjacentChannelRejection", DoubleValue (rejectionDb));
+  // about -90 dBm at 129 m: above the -96 dBm detection threshold, and
+  // below the -99 dBm CCA threshold once 16 dB are rejected
+  Ptr<SpcPhy> phys[3];
+  phys[0] = CreatePhy (channel, 0);
+  phys[1] = CreatePhy (channel, 129, 0);
+  phys[2] = CreatePhy (channel, 0, 129);
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      phys[i]->SetAttribute ("ChannelWidth", UintegerValue (width));
+    }
+  // 20 MHz above the sender
+  phys[2]->SetAttribute ("ChannelNumber", UintegerValue (5));
+  phys[1]->GetPhyStateHelper ()->RegisterListener (coChannel);
+  phys[2]->GetPhyStateHelper ()->RegisterListener (adjacent);
+  Simulator::Schedule (Seconds (1), &SendFrame, phys[0], 100);
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+void
+SpcAdjacentChannelTestCase::DoRun (void)
+{
+  SpcPreamble preamble;
+  Time end = Seconds (1) + Seconds (129 / 299792458.0) + Seconds (100.0 / preamble.GetRate ()) + preamble.GetDuration ();
+
+  SpcRxRecorder coChannel, adjacent;
+  Run (5, 20, &coChannel, &adjacent);
+  NS_TEST_ASSERT_MSG_EQ (coChannel.rxStarts.size (), 1, "the co-channel phy should receive the frame");
+  NS_TEST_ASSERT_MSG_EQ (adjacent.rxStarts.size (), 0, "the adjacent channel phy received the frame");
+  NS_TEST_ASSERT_MSG_EQ (adjacent.ccaBusyEnds.size (), 1, "the frame should still be energy on the adjacent channel");
+  NS_TEST_ASSERT_MSG_EQ (adjacent.ccaBusyEnds[0], end, "wrong end of the energy on the adjacent channel");
+
+  SpcRxRecorder coChannel2, adjacent2;
+  Run (16, 20, &coChannel2, &adjacent2);
+  NS_TEST_ASSERT_MSG_EQ (coChannel2.rxStarts.size (), 1, "the co-channel phy should receive the frame");
+  NS_TEST_ASSERT_MSG_EQ (adjacent2.rxStarts.size (), 0, "the adjacent channel phy received the frame");
+  NS_TEST_ASSERT_MSG_EQ (adjacent2.ccaBusyEnds.size (), 0, "the channel rejection was not applied");
+
+  // 40 MHz channels 20 MHz apart overlap: no rejection, but still no reception
+  SpcRxRecorder coChannel3, adjacent3;
+  Run (16, 40, &coChannel3, &adjacent3);
+  NS_TEST_ASSERT_MSG_EQ (adjacent3.rxStarts.size (), 0, "the overlapping channel phy received the frame");
+  NS_TEST_ASSERT_MSG_EQ (adjacent3.ccaBusyEnds.size (), 1, "the overlapping channel was rejected");
+}
+
+class SpcEventPoolTestCase : public TestCase
+{
+public:
+  SpcEventPoolTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcEventPoolTestCase::SpcEventPoolTestCase ()
+  : TestCase ("Receptions allocate no Event after warm-up")
+{
+}
+
+void
+SpcEventPoolTestCase::DoRun (void)
+{
+  SpcInterferenceHelper helper;
+  SpcPreamble preamble;
+  // keep a few events alive, as pending EndReceives do
+  std::deque<Ptr<SpcInterferenceHelper::Event> > pending;
+  for (uint32_t i = 0; i < 100; i++)
+    {
+      pending.push_back (helper.Add (100, MicroSeconds (100), 1e-9, preamble));
+      if (pending.size () > 8)
+        {
+          pending.pop_front ();
+        }
+    }
+  uint64_t warm = helper.GetEventAllocations ();
+  NS_TEST_ASSERT_MSG_EQ (warm, 9, "unexpected number of events in use");
+  // every other frame an aggregate of as many subframes as can be acked,
+  // whose bounds are carried in the preamble copy of the event
+  SpcSubframeBounds bounds;
+  for (uint32_t j = 0; j <= SPC_MAC_MAX_SUBFRAMES; j++)
+    {
+      bounds.Add (j * 100);
+    }
+  for (uint32_t i = 0; i < 1000; i++)
+    {
+      preamble.SetRate (i);
+      preamble.SetNSubframes (i % 2 ? bounds : SpcSubframeBounds ());
+      pending.push_back (helper.Add (i, MicroSeconds (100), 1e-9, preamble));
+      const SpcPreamble &copy = pending.back ()->GetPreamble ();
+      NS_TEST_ASSERT_MSG_EQ (pending.back ()->GetSize (), i, "reused event not reset");
+      NS_TEST_ASSERT_MSG_EQ (copy.GetRate (), i, "reused event not reset");
+      NS_TEST_ASSERT_MSG_EQ (copy.GetNSubframes ().GetN (), i % 2 ? SPC_MAC_MAX_SUBFRAMES + 1 : 0, "reused event not reset");
+      if (i % 2)
+        {
+          NS_TEST_ASSERT_MSG_EQ (copy.GetNSubframes ().Get (SPC_MAC_MAX_SUBFRAMES), SPC_MAC_MAX_SUBFRAMES * 100,
+                                 "subframe bounds not carried");
+        }
+      pending.pop_front ();
+    }
+  NS_TEST_ASSERT_MSG_EQ (helper.GetEventAllocations (), warm, "event allocated after warm-up");
+  helper.EraseEvents ();
+}
+
+class SpcBackgroundDelayTestCase : public TestCase
+{
+public:
+  SpcBackgroundDelayTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Start (void);
+  void Check (void);
+  void AddNothing (void);
+
+  SpcInterferenceHelper m_helper;
+  std::vector<Time> m_energyDurations;
+  std::vector<double> m_backgrounds;
+};
+
+SpcBackgroundDelayTestCase::SpcBackgroundDelayTestCase ()
+  : TestCase ("Background interference counts from the arrival of the frame")
+{
+}
+
+void
+SpcBackgroundDelayTestCase::Start (void)
+{
+  SpcPreamble preamble;
+  m_helper.Add (100, MicroSeconds (100), 1e-9, preamble);
+  m_helper.Add (100, MicroSeconds (300), 0.2e-9, preamble);
+  // a weak frame sent now, arriving after 10 us
+  m_helper.AddBackground (0.9e-9, MicroSeconds (10), MilliSeconds (10));
+}
+
+void
+SpcBackgroundDelayTestCase::Check (void)
+{
+  m_energyDurations.push_back (m_helper.GetEnergyDuration (1e-9));
+  m_backgrounds.push_back (m_helper.GetBackgroundW ());
+}
+
+void
+SpcBackgroundDelayTestCase::AddNothing (void)
+{
+  m_helper.AddBackground (0, Simulator::Now (), MilliSeconds (10));
+}
+
+void
+SpcBackgroundDelayTestCase::DoRun (void)
+{
+  // tau is 10 ms: the weak frame adds 0.9 nW, which keeps the energy
+  // above 1 nW once the first frame ends only if it has arrived
+  Simulator::Schedule (Seconds (0), &SpcBackgroundDelayTestCase::Start, this);
+  Simulator::Schedule (MicroSeconds (5), &SpcBackgroundDelayTestCase::Check, this);
+  Simulator::Schedule (MicroSeconds (20), &SpcBackgroundDelayTestCase::Check, this);
+  Simulator::Schedule (MicroSeconds (30), &SpcBackgroundDelayTestCase::AddNothing, this);
+  Simulator::Schedule (MicroSeconds (40), &SpcBackgroundDelayTestCase::Check, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_backgrounds[0], 0, "background counted before the frame arrived");
+  NS_TEST_ASSERT_MSG_EQ (m_energyDurations[0], MicroSeconds (95), "the energy should end with the first frame");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_backgrounds[1], 0.9e-9 * std::exp (-0.001), 1e-15, "background after the arrival");
+  NS_TEST_ASSERT_MSG_EQ (m_energyDurations[1], MicroSeconds (280), "the energy should end with the second frame");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_backgrounds[2], 0.9e-9 * std::exp (-0.003), 1e-15, "background after a later update");
+  NS_TEST_ASSERT_MSG_EQ (m_energyDurations[2], MicroSeconds (260), "the energy should end with the second frame");
+  m_helper.EraseEvents ();
+}
+
+class SpcNiChangesBoundTestCase : public TestCase
+{
+public:
+  SpcNiChangesBoundTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Receive (void);
+  void Interfere (void);
+  void EndReceive (void);
+
+  SpcInterferenceHelper m_helper;
+};
+
+SpcNiChangesBoundTestCase::SpcNiChangesBoundTestCase ()
+  : TestCase ("NiChanges only grow with the frames overlapping a reception")
+{
+}
+
+void
+SpcNiChangesBoundTestCase::Receive (void)
+{
+  SpcPreamble preamble;
+  m_helper.Add (1000, MicroSeconds (1000), 1e-6, preamble);
+  m_helper.NotifyRxStart ();
+}
+
+void
+SpcNiChangesBoundTestCase::Interfere (void)
+{
+  SpcPreamble preamble;
+  m_helper.Add (10, MicroSeconds (10), 1e-9, preamble);
+}
+
+void
+SpcNiChangesBoundTestCase::EndReceive (void)
+{
+  m_helper.NotifyRxEnd ();
+}
+
+void
+SpcNiChangesBoundTestCase::DoRun (void)
+{
+  // receptions of 1 ms, each hit by 40 short frames, over 100 ms
+  const uint32_t overlapping = 40;
+  for (uint32_t i = 0; i < 100; i++)
+    {
+      Time start = MilliSeconds (i);
+      Simulator::Schedule (start, &SpcNiChangesBoundTestCase::Receive, this);
+      for (uint32_t j = 0; j < overlapping; j++)
+        {
+          Simulator::Schedule (start + MicroSeconds (20 * (j + 1)), &SpcNiChangesBoundTestCase::Interfere, this);
+        }
+      Simulator::Schedule (start + MicroSeconds (1000), &SpcNiChangesBoundTestCase::EndReceive, this);
+    }
+  Simulator::Run ();
+  Simulator::Destroy ();
+  // the start and end of the frame being received and of each overlapping frame
+  NS_TEST_ASSERT_MSG_EQ (m_helper.GetNiChangesHighWaterMark (), 2 + 2 * overlapping,
+                         "changes kept beyond the frames overlapping one reception");
+  m_helper.EraseEvents ();
+}
+
+// PER of a frame received alone by a fresh helper.  An interferer of no
+// power adds NiChanges and sends it down the chunk walk at the same SINR.
+static void
+ReceiveAlone (const SpcPreamble &preamble, double rxPowerW, bool superposed, bool walk,
+              double *per1, double *per2, uint64_t *fastPath)
+{
+  SpcInterferenceHelper helper;
+  helper.SetNoiseFigure (5);
+  Time duration = Seconds (1000.0 / preamble.GetRate ()) + preamble.GetDuration ();
+  Ptr<SpcInterferenceHelper::Event> event = helper.Add (1000, duration, rxPowerW, preamble);
+  helper.NotifyRxStart ();
+  if (walk)
+    {
+      helper.Add (10, MicroSeconds (100), 0, preamble);
+    }
+  if (superposed)
+    {
+      SpcInterferenceHelper::SnrPer2 snrPer2 = helper.CalculateSnrPer2 (event);
+      *per1 = snrPer2.per1;
+      *per2 = snrPer2.per2;
+    }
+  else
+    {
+      *per1 = helper.CalculateSnrPer (event).per;
+      *per2 = 0;
+    }
+  *fastPath = helper.GetFastPathCount ();
+  helper.EraseEvents ();
+}
+
+class SpcFastPathTestCase : public TestCase
+{
+public:
+  SpcFastPathTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void CountFastPath (uint64_t oldValue, uint64_t newValue);
+
+  uint64_t m_fastPath;
+};
+
+SpcFastPathTestCase::SpcFastPathTestCase ()
+  : TestCase ("A frame at a constant SINR is decided as by the chunk walk"),
+    m_fastPath (0)
+{
+}
+
+void
+SpcFastPathTestCase::CountFastPath (uint64_t oldValue, uint64_t newValue)
+{
+  m_fastPath = newValue;
+}
+
+void
+SpcFastPathTestCase::DoRun (void)
+{
+  // both layers of the superposed frame last as long as the payload, so
+  // splitting it into chunks leaves the bytes to send per second alone
+  SpcPreamble preambles[2];
+  preambles[1].SetPower (0.8);
+  preambles[1].SetIsFar (true);
+  preambles[1].SetNLength (1000);
+  preambles[1].SetFLength (1000);
+  for (uint32_t superposed = 0; superposed < 2; superposed++)
+    {
+      // across the decoding threshold of each layer
+      for (uint32_t i = 0; i <= 80; i++)
+        {
+          double rxPowerW = 1e-14 * std::pow (10, i / 20.0);
+          double fast1, fast2, walk1, walk2;
+          uint64_t fastCount, walkCount;
+          ReceiveAlone (preambles[superposed], rxPowerW, superposed, false, &fast1, &fast2, &fastCount);
+          ReceiveAlone (preambles[superposed], rxPowerW, superposed, true, &walk1, &walk2, &walkCount);
+          NS_TEST_ASSERT_MSG_EQ (fastCount, 1, "frame alone not on the fast path");
+          NS_TEST_ASSERT_MSG_EQ (walkCount, 0, "interfered frame on the fast path");
+          NS_TEST_ASSERT_MSG_EQ (fast1, walk1, "decision differs at " << rxPowerW << " W");
+          NS_TEST_ASSERT_MSG_EQ (fast2, walk2, "decision differs at " << rxPowerW << " W");
+        }
+    }
+
+  // the phy reports its count
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  Ptr<SpcPhy> sender = CreatePhy (channel, 0);
+  Ptr<SpcPhy> receiver = CreatePhy (channel, 30);
+  receiver->TraceConnectWithoutContext ("FastPathCount", MakeCallback (&SpcFastPathTestCase::CountFastPath, this));
+  Simulator::Schedule (Seconds (1), &SendFrame, sender, 100);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (m_fastPath, 1, "reception alone not counted on the fast path");
+  Simulator::Destroy ();
+}
+
+class SpcPowerSolverTestCase : public TestCase
+{
+public:
+  SpcPowerSolverTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcPowerSolverTestCase::SpcPowerSolverTestCase ()
+  : TestCase ("Bisection power split is never slower than the sweep")
+{
+}
+
+void
+SpcPowerSolverTestCase::DoRun (void)
+{
+  Ptr<SpcMac> mac = CreateObject<SpcMac> ();
+  uint32_t bandwidth = 20000000;
+  double noiseFloor = mac->GetNoiseFloor (bandwidth);
+  uint32_t sizes[] = { 100, 700, 1500, 3000 };
+  uint32_t nSizes = sizeof (sizes) / sizeof (sizes[0]);
+  for (int e1 = -13; e1 < -6; e1++)
+    {
+      for (int e2 = -13; e2 < -6; e2++)
+        {
+          double passLoss1 = 1.7 * std::pow (10.0, e1);
+          double passLoss2 = std::pow (10.0, e2);
+          bool isFar = passLoss1 < passLoss2;
+          for (uint32_t i = 0; i < nSizes; i++)
+            {
+              for (uint32_t j = 0; j < nSizes; j++)
+                {
+                  SpcMac::PowerTimeRate sweep = mac->SweepPowerTimeRate (passLoss1, passLoss2, sizes[i], sizes[j],
+                                                                         bandwidth, noiseFloor, isFar);
+                  SpcMac::PowerTimeRate bisect = mac->BisectPowerTimeRate (passLoss1, passLoss2, sizes[i], sizes[j],
+                                                                           bandwidth, noiseFloor, isFar);
+                  NS_TEST_ASSERT_MSG_EQ (bisect.time <= sweep.time, true,
+                                         "bisection slower at passLoss1=" << passLoss1 << " passLoss2=" << passLoss2 <<
+                                         " size1=" << sizes[i] << " size2=" << sizes[j]);
+                }
+            }
+        }
+    }
+  mac->Dispose ();
+  Simulator::Destroy ();
+}
+
+class SpcPowerTableTestCase : public TestCase
+{
+public:
+  SpcPowerTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcPowerTableTestCase::SpcPowerTableTestCase ()
+  : TestCase ("Power split table stays close to bisection between grid points")
+{
+}
+
+void
+SpcPowerTableTestCase::DoRun (void)
+{
+  Ptr<SpcMac> mac = CreateObject<SpcMac> ();
+  uint32_t bandwidth = 20000000;
+  double noiseFloor = mac->GetNoiseFloor (bandwidth);
+  for (double snr1Db = -4.5; snr1Db < 45; snr1Db += 3.7)
+    {
+      for (double snr2Db = -4.5; snr2Db < 45; snr2Db += 4.1)
+        {
+          double passLoss1 = noiseFloor * std::pow (10.0, snr1Db / 10);
+          double passLoss2 = noiseFloor * std::pow (10.0, snr2Db / 10);
+          bool isFar = passLoss1 < passLoss2;
+          for (uint32_t size1 = 100; size1 <= 3000; size1 += 700)
+            {
+              SpcMac::PowerTimeRate bisect = mac->BisectPowerTimeRate (passLoss1, passLoss2, size1, 1500,
+                                                                       bandwidth, noiseFloor, isFar);
+              SpcMac::PowerTimeRate table = mac->TablePowerTimeRate (passLoss1, passLoss2, size1, 1500,
+                                                                     bandwidth, noiseFloor, isFar);
+              NS_TEST_ASSERT_MSG_EQ_TOL (table.time.GetSeconds (), bisect.time.GetSeconds (),
+                                         bisect.time.GetSeconds () * 0.03,
+                                         "table airtime off at snr1=" << snr1Db << " snr2=" << snr2Db <<
+                                         " size1=" << size1);
+            }
+        }
+    }
+  mac->Dispose ();
+  Simulator::Destroy ();
+}
+
+class SpcPairingCacheTestCase : public TestCase
+{
+public:
+  SpcPairingCacheTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void CheckDecisions (Ptr<SpcMac> mac, std::string what);
+};
+
+SpcPairingCacheTestCase::SpcPairingCacheTestCase ()
+  : TestCase ("Cached pairing decisions equal a fresh search")
+{
+}
+
+void
+SpcPairingCacheTestCase::CheckDecisions (Ptr<SpcMac> mac, std::string what)
+{
+  double resolutionDb = mac->GetPairingCacheResolution ();
+  for (double loss1Db = -95.03; loss1Db < -50; loss1Db += 7.9)
+    {
+      for (double loss2Db = -95.07; loss2Db < -50; loss2Db += 11.3)
+        {
+          // a miss, then a query a fraction of a step away
+          for (uint32_t k = 0; k < 2; k++)
+            {
+              double query1Db = loss1Db + k * resolutionDb * 0.3;
+              double query2Db = loss2Db - k * resolutionDb * 0.3;
+              SpcMac::TimeNum1Num2 cached;
+              mac->GetPacketNums (std::pow (10.0, query1Db / 10), std::pow (10.0, query2Db / 10), 1000, 400, &cached);
+              SpcMac::TimeNum1Num2 fresh;
+              double rounded1Db = std::floor (query1Db / resolutionDb + 0.5) * resolutionDb;
+              double rounded2Db = std::floor (query2Db / resolutionDb + 0.5) * resolutionDb;
+              mac->SearchPacketNums (std::pow (10.0, rounded1Db / 10), std::pow (10.0, rounded2Db / 10),
+                                     1000, 400, &fresh);
+              NS_TEST_ASSERT_MSG_EQ (cached.num1, fresh.num1, what << ": num1 at " << loss1Db << ", " << loss2Db << " dB");
+              NS_TEST_ASSERT_MSG_EQ (cached.num2, fresh.num2, what << ": num2 at " << loss1Db << ", " << loss2Db << " dB");
+            }
+        }
+    }
+}
+
+void
+SpcPairingCacheTestCase::DoRun (void)
+{
+  Ptr<SpcMac> mac = CreateObject<SpcMac> ();
+  CheckDecisions (mac, "bisection");
+  NS_TEST_ASSERT_MSG_EQ (mac->GetPairingCacheEntries () > 0, true, "nothing cached");
+
+  // every input of the decisions flushes the cache
+  mac->SetAttribute ("PowerSolver", EnumValue (SpcMac::POWER_SWEEP));
+  NS_TEST_ASSERT_MSG_EQ (mac->GetPairingCacheEntries (), 0, "PowerSolver did not flush the cache");
+  CheckDecisions (mac, "sweep");
+  mac->SetAttribute ("PowerSolver", EnumValue (SpcMac::POWER_BISECTION));
+  mac->SetAttribute ("PowerPrecision", DoubleValue (0.01));
+  NS_TEST_ASSERT_MSG_EQ (mac->GetPairingCacheEntries (), 0, "PowerPrecision did not flush the cache");
+  CheckDecisions (mac, "coarse bisection");
+  mac->SetAttribute ("PowerSolver", EnumValue (SpcMac::POWER_TABLE));
+  CheckDecisions (mac, "table");
+  mac->SetAttribute ("PowerTableFile", StringValue (""));
+  NS_TEST_ASSERT_MSG_EQ (mac->GetPairingCacheEntries (), 0, "PowerTableFile did not flush the cache");
+  mac->SetAttribute ("CapacityLog2", EnumValue (SpcCapacity::FAST));
+  CheckDecisions (mac, "fast log2");
+  mac->SetAttribute ("PairingCacheResolution", DoubleValue (1));
+  NS_TEST_ASSERT_MSG_EQ (mac->GetPairingCacheEntries (), 0, "PairingCacheResolution did not flush the cache");
+  CheckDecisions (mac, "1 dB steps");
+
+  // a full cache evicts one entry at a time
+  mac->SetAttribute ("PairingCacheSize", UintegerValue (4));
+  SpcMac::TimeNum1Num2 tnn;
+  for (uint32_t i = 0; i < 10; i++)
+    {
+      mac->GetPacketNums (std::pow (10.0, (-90.0 + i) / 10), 1e-7, 1000, 400, &tnn);
+      NS_TEST_ASSERT_MSG_EQ (mac->GetPairingCacheEntries (), std::min<uint32_t> (i + 1, 4), "wrong eviction");
+    }
+  mac->Dispose ();
+  Simulator::Destroy ();
+}
+
+class SpcAggregateTestCase : public TestCase
+{
+public:
+  SpcAggregateTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcAggregateTestCase::SpcAggregateTestCase ()
+  : TestCase ("Aggregate frame carries its subframes unchanged")
+{
+}
+
+void
+SpcAggregateTestCase::DoRun (void)
+{
+  uint32_t sizes[] = { 100, 1, 1500 };
+  uint32_t nSizes = sizeof (sizes) / sizeof (sizes[0]);
+  Ptr<Packet> frame = Create<Packet> ();
+  for (uint32_t i = 0; i < nSizes; i++)
+    {
+      Ptr<Packet> subframe = Create<Packet> (sizes[i]);
+      SpcAmsduSubframeHeader subhdr;
+      subhdr.SetLength (sizes[i]);
+      subframe->AddHeader (subhdr);
+      frame->AddAtEnd (subframe);
+    }
+  SpcMacHeader hdr;
+  hdr.SetType (SPC_MAC_DATA_SPC);
+  hdr.SetSpcNum (SpcMacHeader::SECOND);
+  hdr.SetAggregate (true);
+  frame->AddHeader (hdr);
+
+  SpcMacHeader received;
+  frame->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.GetType (), SPC_MAC_DATA_SPC, "type lost");
+  NS_TEST_ASSERT_MSG_EQ (received.GetSpcNum (), SpcMacHeader::SECOND, "layer lost");
+  NS_TEST_ASSERT_MSG_EQ (received.IsAggregate (), true, "aggregate flag lost");
+  for (uint32_t i = 0; i < nSizes; i++)
+    {
+      SpcAmsduSubframeHeader subhdr;
+      frame->RemoveHeader (subhdr);
+      NS_TEST_ASSERT_MSG_EQ (subhdr.GetLength (), sizes[i], "wrong length of subframe " << i);
+      frame->RemoveAtStart (subhdr.GetLength ());
+    }
+  NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), 0, "bytes left after the last subframe");
+}
+
+class SpcAggregateForwardTestCase : public TestCase
+{
+public:
+  SpcAggregateForwardTestCase ();
+
+private:
+  virtual void DoRun (void);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from);
+
+  std::vector<uint32_t> m_sizes;
+  std::vector<uint16_t> m_protocols;
+};
+
+SpcAggregateForwardTestCase::SpcAggregateForwardTestCase ()
+  : TestCase ("An aggregate built by the MAC is passed up one packet at a time")
+{
+}
+
+bool
+SpcAggregateForwardTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  m_sizes.push_back (packet->GetSize ());
+  m_protocols.push_back (protocol);
+  return true;
+}
+
+void
+SpcAggregateForwardTestCase::DoRun (void)
+{
+  Ptr<SpcNetDevice> device = CreateObject<SpcNetDevice> ();
+  Mac48Address to ("00:00:00:00:00:01");
+  Mac48Address from ("00:00:00:00:00:02");
+  device->SetAddress (to);
+  device->SetReceiveCallback (MakeCallback (&SpcAggregateForwardTestCase::Receive, this));
+  Ptr<SpcMac> mac = device->GetMac ();
+
+  uint32_t sizes[] = { 100, 1, 1500, 700 };
+  uint32_t nSizes = sizeof (sizes) / sizeof (sizes[0]);
+  std::vector<Ptr<const Packet> > packets;
+  for (uint32_t i = 0; i < nSizes; i++)
+    {
+      Ptr<Packet> packet = Create<Packet> (sizes[i]);
+      LlcSnapHeader llc;
+      llc.SetType (0x0800 + i);
+      packet->AddHeader (llc);
+      packets.push_back (packet);
+    }
+  std::list<Ptr<const Packet> > aggregate (packets.begin () + 1, packets.end ());
+  Ptr<Packet> body = mac->CreateFrameBody (packets[0], aggregate);
+  SpcAmsduSubframeHeader subhdr;
+  uint32_t expected = 0;
+  for (uint32_t i = 0; i < nSizes; i++)
+    {
+      expected += subhdr.GetSerializedSize () + packets[i]->GetSize ();
+    }
+  NS_TEST_ASSERT_MSG_EQ (body->GetSize (), expected, "wrong aggregate size");
+
+  // the receiver gets the body with the FCS
+  SpcMacTrailer fcs;
+  body->AddTrailer (fcs);
+  uint16_t bitmap = mac->ForwardUp (body, true, to, from, 0xffff);
+  NS_TEST_ASSERT_MSG_EQ (bitmap, (1 << nSizes) - 1, "wrong block-ack bitmap");
+  NS_TEST_ASSERT_MSG_EQ (m_sizes.size (), nSizes, "wrong number of packets passed up");
+  for (uint32_t i = 0; i < nSizes; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_sizes[i], sizes[i], "wrong size of packet " << i);
+      NS_TEST_ASSERT_MSG_EQ (m_protocols[i], 0x0800 + i, "packet " << i << " out of order");
+    }
+
+  // the airtime estimates size an aggregate of equal packets the same way
+  std::list<Ptr<const Packet> > same (2, packets[2]);
+  Ptr<Packet> frame = mac->CreateFrameBody (packets[2], same);
+  SpcMacHeader hdr;
+  hdr.SetType (SPC_MAC_DATA_SPC);
+  NS_TEST_ASSERT_MSG_EQ (mac->GetSpcFrameSize (packets[2]->GetSize (), 3), frame->GetSize () + hdr.GetSize () + fcs.GetSize (),
+                         "GetSpcFrameSize does not match the frame built");
+  device->Dispose ();
+  Simulator::Destroy ();
+}
+
+class SpcBlockAckTestCase : public TestCase
+{
+public:
+  SpcBlockAckTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void CountSojourn (Time sojourn);
+
+  uint32_t m_sojourns;
+};
+
+SpcBlockAckTestCase::SpcBlockAckTestCase ()
+  : TestCase ("Lost subframes go back to the head of the queue in order")
+{
+}
+
+void
+SpcBlockAckTestCase::CountSojourn (Time sojourn)
+{
+  m_sojourns++;
+}
+
+void
+SpcBlockAckTestCase::DoRun (void)
+{
+  SpcMacHeader ack;
+  ack.SetType (SPC_MAC_ACK);
+  ack.SetBlockAck (0xa5);
+  Ptr<Packet> frame = Create<Packet> ();
+  frame->AddHeader (ack);
+  NS_TEST_ASSERT_MSG_EQ (frame->GetSize (), ack.GetSize (), "ACK size does not match its header");
+  SpcMacHeader received;
+  frame->RemoveHeader (received);
+  NS_TEST_ASSERT_MSG_EQ (received.GetBlockAck (), 0xa5, "bitmap lost");
+
+  m_sojourns = 0;
+  Ptr<SpcMacQueue> queue = CreateObject<SpcMacQueue> ();
+  Ptr<NodeInformationTable> nodeTable = CreateObject<NodeInformationTable> ();
+  queue->SetNodeTable (nodeTable);
+  queue->TraceConnectWithoutContext ("Sojourn", MakeCallback (&SpcBlockAckTestCase::CountSojourn, this));
+  SpcMacHeader hdrA, hdrB;
+  hdrA.SetType (SPC_MAC_DATA);
+  hdrA.SetAddr1 (Mac48Address ("00:00:00:00:00:01"));
+  hdrB.SetType (SPC_MAC_DATA);
+  hdrB.SetAddr1 (Mac48Address ("00:00:00:00:00:02"));
+  std::vector<Ptr<const Packet> > a;
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      a.push_back (Create<Packet> (100 + i));
+      queue->Enqueue (a.back (), hdrA);
+      queue->Enqueue (Create<Packet> (10), hdrB);
+    }
+  SpcMacHeader hdr;
+  PacketInfo info;
+  NS_TEST_ASSERT_MSG_EQ (queue->Dequeue (&hdr, &info), a[0], "wrong head");
+  std::list<Ptr<const Packet> > aggregate;
+  queue->Aggregation (hdrA.GetAddr1 (), info.GetDestPort (), 3, &aggregate);
+  NS_TEST_ASSERT_MSG_EQ (aggregate.size (), 2, "wrong number of packets aggregated");
+  // subframes 1 and 2 were lost: they are pushed back last first
+  queue->PushFront (a[2], hdrA);
+  queue->PushFront (a[1], hdrA);
+  NS_TEST_ASSERT_MSG_EQ (queue->Dequeue (&hdr), a[1], "lost subframes out of order");
+  NS_TEST_ASSERT_MSG_EQ (queue->PeekByDestination (hdrA.GetAddr1 (), info.GetDestPort (), &hdr), a[2],
+                         "index not updated by PushFront");
+  NS_TEST_ASSERT_MSG_EQ (queue->GetSize (), 6, "wrong queue size");
+  // a requeued packet is neither new traffic nor a second sojourn sample
+  NS_TEST_ASSERT_MSG_EQ (m_sojourns, 3, "requeued packet traced twice");
+  nodeTable->UpdateTraffic (Seconds (1));
+  NS_TEST_ASSERT_MSG_EQ (nodeTable->GetTraffic (hdrA.GetAddr1 ()), 100 + 101 + 102 + 103,
+                         "requeued packets counted twice by the node table");
+  Simulator::Destroy ();
+}
+
+static void
+SendAggregate (Ptr<SpcPhy> phy, Ptr<Packet> frame, SpcPreamble preamble)
+{
+  phy->StartSend (frame, preamble);
+}
+
+class SpcSubframeLossTestCase : public TestCase
+{
+public:
+  SpcSubframeLossTestCase ();
+
+private:
+  virtual void DoRun (void);
+  bool Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from);
+
+  std::vector<uint16_t> m_protocols;
+};
+
+SpcSubframeLossTestCase::SpcSubframeLossTestCase ()
+  : TestCase ("Interference over one subframe of an aggregate loses and requeues only that subframe")
+{
+}
+
+bool
+SpcSubframeLossTestCase::Receive (Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from)
+{
+  m_protocols.push_back (protocol);
+  return true;
+}
+
+void
+SpcSubframeLossTestCase::DoRun (void)
+{
+  Ptr<SpcNetDevice> device = CreateObject<SpcNetDevice> ();
+  Mac48Address to ("00:00:00:00:00:01");
+  Mac48Address from ("00:00:00:00:00:02");
+  device->SetAddress (to);
+  device->SetReceiveCallback (MakeCallback (&SpcSubframeLossTestCase::Receive, this));
+  Ptr<SpcMac> mac = device->GetMac ();
+
+  std::vector<Ptr<const Packet> > packets;
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Ptr<Packet> packet = Create<Packet> (200);
+      LlcSnapHeader llc;
+      llc.SetType (0x0800 + i);
+      packet->AddHeader (llc);
+      packets.push_back (packet);
+    }
+  std::list<Ptr<const Packet> > aggregate (1, packets[1]);
+  Ptr<Packet> frame = mac->CreateFrameBody (packets[0], aggregate);
+  SpcMacHeader hdr;
+  hdr.SetType (SPC_MAC_DATA);
+  hdr.SetAddr1 (to);
+  hdr.SetAddr2 (from);
+  hdr.SetAggregate (true);
+  frame->AddHeader (hdr);
+  SpcMacTrailer fcs;
+  frame->AddTrailer (fcs);
+  SpcPreamble preamble;
+  preamble.SetNLength (frame->GetSize () - hdr.GetSize ());
+  preamble.SetNSubframes (mac->GetSubframeBounds (packets[0], aggregate));
+  const SpcSubframeBounds &bounds = preamble.GetNSubframes ();
+  NS_TEST_ASSERT_MSG_EQ (bounds.GetN (), 3, "wrong number of subframe bounds");
+  NS_TEST_ASSERT_MSG_EQ (bounds.Get (2) + fcs.GetSize (), preamble.GetNLength (), "the bounds do not match the body");
+
+  // a short frame next to the receiver, sent 50 bytes into the second subframe
+  Ptr<SpcChannel> channel = CreateObject<SpcChannel> ();
+  Ptr<SpcPhy> sender = CreatePhy (channel, 0);
+  Ptr<SpcPhy> receiver = CreatePhy (channel, 60);
+  Ptr<SpcPhy> interferer = CreatePhy (channel, 63);
+  SpcRxRecorder recorder;
+  receiver->GetPhyStateHelper ()->RegisterListener (&recorder);
+  Simulator::Schedule (Seconds (1), &SendAggregate, sender, frame, preamble);
+  Time interference = Seconds (1) + preamble.GetDuration () +
+    Seconds ((hdr.GetSize () + bounds.Get (1) + 50.0) / preamble.GetRate ());
+  Simulator::Schedule (interference, &SendFrame, interferer, 10);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (recorder.rxEnds.size (), 1, "the frame outside its subframes should be received");
+  NS_TEST_ASSERT_MSG_EQ (recorder.subframeBitmaps[0] & 3, 1, "only the second subframe should be lost");
+
+  // the receiver passes up and acknowledges the first subframe only
+  Ptr<Packet> copy = recorder.packets[0]->Copy ();
+  copy->RemoveHeader (hdr);
+  uint16_t bitmap = mac->ForwardUp (copy, true, to, from, recorder.subframeBitmaps[0]);
+  NS_TEST_ASSERT_MSG_EQ (bitmap, 1, "wrong block-ack bitmap");
+  NS_TEST_ASSERT_MSG_EQ (m_protocols.size (), 1, "a lost subframe was passed up");
+  NS_TEST_ASSERT_MSG_EQ (m_protocols[0], 0x0800, "wrong subframe passed up");
+
+  // and the sender queues the second one again, alone
+  mac->RequeueLost (packets[0], aggregate, hdr, bitmap);
+  Ptr<SpcMacQueue> queue = mac->GetQueue ();
+  NS_TEST_ASSERT_MSG_EQ (queue->GetSize (), 1, "wrong number of subframes requeued");
+  SpcMacHeader requeued;
+  NS_TEST_ASSERT_MSG_EQ (queue->Dequeue (&requeued), packets[1], "wrong subframe requeued");
+  device->Dispose ();
+  Simulator::Destroy ();
+}
+
+class SpcControlledDelayTestCase : public TestCase
+{
+public:
+  SpcControlledDelayTestCase ();
+
+private:
+  virtual void DoRun (void);
+  /// Drops of a queue sending one packet per millisecond for a second
+  uint32_t RunQueue (bool controlledDelay);
+  void DequeueOne (Ptr<SpcMacQueue> queue);
+  void CountDrop (Ptr<const Packet> packet);
+  void RecordSojourn (Time sojourn);
+
+  uint32_t m_drops;
+  Time m_lastSojourn;
+};
+
+SpcControlledDelayTestCase::SpcControlledDelayTestCase ()
+  : TestCase ("CoDel brings the sojourn time of a saturated queue down")
+{
+}
+
+void
+SpcControlledDelayTestCase::DequeueOne (Ptr<SpcMacQueue> queue)
+{
+  SpcMacHeader hdr;
+  queue->Dequeue (&hdr);
+}
+
+void
+SpcControlledDelayTestCase::CountDrop (Ptr<const Packet> packet)
+{
+  m_drops++;
+}
+
+void
+SpcControlledDelayTestCase::RecordSojourn (Time sojourn)
+{
+  m_lastSojourn = sojourn;
+}
+
+uint32_t
+SpcControlledDelayTestCase::RunQueue (bool controlledDelay)
+{
+  m_drops = 0;
+  Ptr<SpcMacQueue> queue = CreateObject<SpcMacQueue> ();
+  queue->SetAttribute ("ControlledDelay", BooleanValue (controlledDelay));
+  // a short interval lets the drop rate catch up within the run
+  queue->SetAttribute ("Interval", TimeValue (MilliSeconds (10)));
+  queue->SetNodeTable (CreateObject<NodeInformationTable> ());
+  queue->TraceConnectWithoutContext ("Drop", MakeCallback (&SpcControlledDelayTestCase::CountDrop, this));
+  queue->TraceConnectWithoutContext ("Sojourn", MakeCallback (&SpcControlledDelayTestCase::RecordSojourn, this));
+  SpcMacHeader hdr;
+  hdr.SetType (SPC_MAC_DATA);
+  hdr.SetAddr1 (Mac48Address ("00:00:00:00:00:01"));
+  // four packets arrive for every three sent
+  for (uint32_t i = 0; i < 1333; i++)
+    {
+      Simulator::Schedule (MicroSeconds (750 * i), &SpcMacQueue::Enqueue, queue, Create<Packet> (100), hdr);
+    }
+  for (uint32_t i = 1; i <= 1000; i++)
+    {
+      Simulator::Schedule (MilliSeconds (i), &SpcControlledDelayTestCase::DequeueOne, this, queue);
+    }
+  Simulator::Run ();
+  Simulator::Destroy ();
+  return m_drops;
+}
+
+void
+SpcControlledDelayTestCase::DoRun (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (RunQueue (false), 0, "drops below MaxPacketNumber without CoDel");
+  NS_TEST_ASSERT_MSG_GT (m_lastSojourn, MilliSeconds (200), "queue did not build up");
+  NS_TEST_ASSERT_MSG_GT (RunQueue (true), 0, "CoDel dropped nothing");
+  NS_TEST_ASSERT_MSG_LT (m_lastSojourn, MilliSeconds (50), "CoDel left a standing queue");
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
 //
+// A UDP datagram of 1000 bytes framed with IPv4 and LLC/SNAP, or a
+// later fragment of one, which carries no UDP header
+static Ptr<Packet>
+CreateDatagram (uint16_t fragmentOffset)
+{
+  Ptr<Packet> packet = Create<Packet> (1000);
+  if (fragmentOffset == 0)
+    {
+      UdpHeader udp;
+      udp.SetDestinationPort (9);
+      packet->AddHeader (udp);
+    }
+  Ipv4Header ipv4;
+  ipv4.SetProtocol (17);
+  ipv4.SetPayloadSize (packet->GetSize ());
+  ipv4.SetFragmentOffset (fragmentOffset);
+  packet->AddHeader (ipv4);
+  LlcSnapHeader llc;
+  llc.SetType (0x0800);
+  packet->AddHeader (llc);
+  return packet;
+}
+
+class SpcFragmentInfoTestCase : public TestCase
+{
+public:
+  SpcFragmentInfoTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+SpcFragmentInfoTestCase::SpcFragmentInfoTestCase ()
+  : TestCase ("Only the first IPv4 fragment is read for a UDP header")
+{
+}
+
+void
+SpcFragmentInfoTestCase::DoRun (void)
+{
+  PacketInfo first;
+  first.SetPacketInfo (CreateDatagram (0));
+  NS_TEST_ASSERT_MSG_EQ (first.GetSize (), 1000, "UDP header not taken off the first fragment");
+  NS_TEST_ASSERT_MSG_EQ (first.GetDestPort (), 9, "wrong port in the first fragment");
+  PacketInfo later;
+  later.SetPacketInfo (CreateDatagram (1008));
+  NS_TEST_ASSERT_MSG_EQ (later.GetSize (), 1000, "payload of a later fragment read as a UDP header");
+}
+
 class SpcMacTestSuite : public TestSuite
 {
 public:
@@ -61,6 +1374,25 @@ SpcMacTestSuite::SpcMacTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new SpcMacTestCase1, TestCase::QUICK);
+  AddTestCase (new SpcCapacityTestCase, TestCase::QUICK);
+  AddTestCase (new SpcEventPoolTestCase, TestCase::QUICK);
+  AddTestCase (new SpcBackgroundDelayTestCase, TestCase::QUICK);
+  AddTestCase (new SpcNiChangesBoundTestCase, TestCase::QUICK);
+  AddTestCase (new SpcFastPathTestCase, TestCase::QUICK);
+  AddTestCase (new SpcFanOutTestCase, TestCase::QUICK);
+  AddTestCase (new SpcSharedMobilityTestCase, TestCase::QUICK);
+  AddTestCase (new SpcSharedLinkCacheTestCase, TestCase::QUICK);
+  AddTestCase (new SpcBatchRxPowerTestCase, TestCase::QUICK);
+  AddTestCase (new SpcAdjacentChannelTestCase, TestCase::QUICK);
+  AddTestCase (new SpcPowerSolverTestCase, TestCase::QUICK);
+  AddTestCase (new SpcPairingCacheTestCase, TestCase::QUICK);
+  AddTestCase (new SpcPowerTableTestCase, TestCase::QUICK);
+  AddTestCase (new SpcAggregateTestCase, TestCase::QUICK);
+  AddTestCase (new SpcAggregateForwardTestCase, TestCase::QUICK);
+  AddTestCase (new SpcBlockAckTestCase, TestCase::QUICK);
+  AddTestCase (new SpcSubframeLossTestCase, TestCase::QUICK);
+  AddTestCase (new SpcControlledDelayTestCase, TestCase::QUICK);
+  AddTestCase (new SpcFragmentInfoTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite